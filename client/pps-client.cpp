@@ -40,11 +40,6 @@
 
 #include "../client/pps-client.h"
 
-/**
- * System call
- */
-extern int adjtimex (struct timex *timex);
-
 /**
  * System call
  */
@@ -55,20 +50,43 @@ const char *version = "2.0.4";							//!< Program v2.0.3 updated on 11 Jan 2021
 struct G g;												//!< Declares the global variables defined in pps-client.h.
 
 extern struct ppsFiles f;
+extern struct clockBackend *clk;
 extern bool writeJitterDistrib;
 extern bool writeErrorDistrib;
+extern struct sketchStream jitterSketch;
+extern struct sketchStream correctionSketch;
 
 static double rawErrorAvg = 0.0;						// Variable cannot be in the G struct because
 														// it is cleared on every restart.
-class List rawErr(SLEW_LEN);
 bool threadIsRunning = false;
 bool readState = false;
 
+/**
+ * Local file-scope variables for the absolute
+ * deadline timing of the waitForPPS() loop.
+ */
+static struct syncTimerVars {
+	int64_t wakeTime;									// Next wakeup as an absolute CLOCK_MONOTONIC time in nanoseconds
+	int64_t realtimeOffset;								// CLOCK_REALTIME - CLOCK_MONOTONIC in nanoseconds
+	int clockSetFd;										// timerfd that signals discontinuous changes to CLOCK_REALTIME
+	bool isAnchored;									// "true" while realtimeOffset is valid
+	bool ppsReceived;									// Set when a PPS timestamp was read in the current second
+	time_t ppsSec;										// That PPS timestamp rounded to the nearest second
+	int window;											// Adaptive PPS window: the wakeup lead before the PPS in microseconds
+	int lateness;										// LATENESS_QUANTILE of the wakeup lateness in microseconds
+	unsigned int latenessCount;							// Count of wakeups recorded in latenessDistrib
+	double latenessWeight;								// Weight of a new sample in latenessDistrib
+	double latenessDistrib[LATENESS_DISTRIB_LEN];		// Decaying distribution of the wakeup lateness
+	bool isLate;										// "true" if the deadline of this second had passed before the sleep
+	unsigned int missedDeadlines;						// Count of those seconds
+} st = {0, 0, -1, false, false, 0, PPS_WINDOW, 0, 0, 0.0, {0.0}, false, 0};
+
 
 /**
  * Sets global variables to initial values at
  * startup or restart and sets system clock
- * frequency offset to zero.
+ * frequency offset to zero or to the offset
+ * predicted by the drift model.
  *
  * @param[in] verbose Enables printing of state status params when "true".
  */
@@ -85,10 +103,17 @@ int initialize(bool verbose){
 
 	g.t3.modes = ADJ_FREQUENCY;			// Initialize system clock
 	g.t3.freq = 0;						// frequency offset to zero.
-	adjtimex(&g.t3);
+	clk->adjustClock(&g.t3);
 
 	rv = getConfigs();
 
+	g.usecScale = 1;						// The units of the controller error values
+	if (isEnabled(NANOSECOND)){				// can only change at startup or restart.
+		g.usecScale = NSECS_PER_USEC;
+	}
+
+	seedFrequency();						// Start from the frequency offset predicted by the drift model.
+
 	g.cpuVersion = getRPiCPU();
 	if (g.cpuVersion == 3){
 		g.zeroOffset = ZERO_OFFSET_RPI3;
@@ -137,7 +162,7 @@ int initialize(bool verbose){
  */
 bool getAcquireState(void){
 
-	if (! g.slewIsLow && g.slewAccum_cnt == 0
+	if (! g.slewIsLow && g.slewAccum_cnt == SLEW_LEN
 			&& fabs(g.avgSlew) < SLEW_MAX){					// SLEW_MAX only needs to be low enough
 		g.slewIsLow = true;									// that the controller can begin locking
 	}														// at limitValue == HARD_LIMIT_NONE
@@ -194,26 +219,100 @@ void setHardLimit(double avgCorrection){
 }
 
 /**
- * Gets the average time offset from zero over the interval
- * SLEW_LEN and updates avgSlew with this value every SLEW_LEN
- * seconds. Excludes all large delay spikes from the average.
+ * Replaces the value old in the ascending array sorted
+ * of length n with val, keeping the array in order.
+ * Only the values between the positions of old and val
+ * are moved.
+ */
+static void replaceSorted(int *sorted, int n, int old, int val){
+	int low = 0, high = n - 1;
+
+	while (low < high){										// Binary search for old
+		int mid = (low + high) / 2;
+		if (sorted[mid] < old){
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+
+	int i = low;
+	while (i < n - 1 && sorted[i + 1] < val){
+		sorted[i] = sorted[i + 1];
+		i += 1;
+	}
+	while (i > 0 && sorted[i - 1] > val){
+		sorted[i] = sorted[i - 1];
+		i -= 1;
+	}
+	sorted[i] = val;
+}
+
+/**
+ * Returns the average of the values in the ascending
+ * array sorted of length n from the lowest value up to
+ * the first gap between adjacent values of maxVal or more.
+ *
+ * @param[in] sorted The ascending array.
+ * @param[in] n The length of the array.
+ * @param[in] maxVal The gap at which to stop.
+ *
+ * @returns The average below the gap.
+ */
+static double averageBelow(const int *sorted, int n, int maxVal){
+	int sum = 0;
+	int i;
+
+	for (i = 0; i < n; i++){
+		sum += sorted[i];
+
+		if (i < n - 1 && sorted[i + 1] - sorted[i] >= maxVal){
+			i += 1;
+			break;
+		}
+	}
+	return (double)sum / (double)i;
+}
+
+/**
+ * Gets the average time offset from zero over a sliding
+ * window of the last SLEW_LEN seconds and updates avgSlew
+ * with this value each second once the window is full.
+ * Excludes all large delay spikes from the average.
+ *
+ * The window is kept both in arrival order, to find the
+ * value that leaves it, and in sorted order, to find the
+ * values below the large delay spikes.
  *
  * @param[in] rawError The raw error to be accumulated to
  * determine average slew including delay spikes.
  */
 void getTimeSlew(int rawError){
+	int n = g.slewAccum_cnt;
 
-	rawErr.binaryInsert(rawError);							// Store rawError samples in sorted order of absolute
-															// delay to allow rawErr.averageBelow() to ignore
-	g.slewAccum_cnt += 1;									// the samples above the LARGE_SPIKE level.
-
+	if (n < SLEW_LEN){
+		int i = n;
+		while (i > 0 && g.slewSorted[i - 1] > rawError){
+			g.slewSorted[i] = g.slewSorted[i - 1];
+			i -= 1;
+		}
+		g.slewSorted[i] = rawError;
+		g.slewWindow[n] = rawError;
+		g.slewAccum_cnt += 1;
+	}
+	else {
+		int old = g.slewWindow[g.slewIdx];
+		replaceSorted(g.slewSorted, SLEW_LEN, old, rawError);
+		g.slewWindow[g.slewIdx] = rawError;
+		g.slewIdx = (g.slewIdx + 1) % SLEW_LEN;
+		g.slewAccum -= (double)old;
+	}
 	g.slewAccum += (double)rawError;
 
-	if (g.slewAccum_cnt >= SLEW_LEN){
-		g.slewAccum_cnt = 0;
-
+	if (g.slewAccum_cnt == SLEW_LEN){
 		double avg = g.slewAccum / (double)SLEW_LEN;
-		double avgBelow = rawErr.averageBelow(LARGE_SPIKE);  // Do the average only below the LARGE_SPIKE level
+		double avgBelow = averageBelow(g.slewSorted, SLEW_LEN, LARGE_SPIKE);  // Do the average only below the LARGE_SPIKE level
 
 		if (fabs(avg) < fabs(avgBelow)){
 			g.avgSlew = avg;
@@ -221,9 +320,6 @@ void getTimeSlew(int rawError){
 		else {
 			g.avgSlew = avgBelow;
 		}
-
-		g.slewAccum = 0.0;
-		rawErr.clear();
 	}
 }
 
@@ -243,12 +339,12 @@ void getTimeSlew(int rawError){
  * delay to its median value.
  *
  * @param[in] rawError The raw error value to be converted to a
- * zero error.
+ * zero error in units of 1/G.usecScale microseconds.
  */
 int clampJitter(int rawError){
 	int maxClamp, posClamp, negClamp;
 
-	maxClamp = g.hardLimit;
+	maxClamp = g.hardLimit * g.usecScale;
 
 	int zeroError = rawError;
 
@@ -264,8 +360,8 @@ int clampJitter(int rawError){
 		negClamp = -maxClamp;
 	}
 	else {
-		posClamp = (int)rawErrorAvg + maxClamp;
-		negClamp = (int)rawErrorAvg - maxClamp;
+		posClamp = (int)(rawErrorAvg * g.usecScale) + maxClamp;
+		negClamp = (int)(rawErrorAvg * g.usecScale) - maxClamp;
 	}
 
 	if (rawError > posClamp){
@@ -358,9 +454,10 @@ bool integralIsReady(void){
  * the servo loop can converge significantly faster using a moving
  * average.
  *
- * @param[in] timeCorrection The time correction value to be accumulated.
+ * @param[in] timeCorrection The time correction value to be accumulated
+ * in units of 1/G.usecScale microseconds.
  *
- * @returns The average correction value.
+ * @returns The average correction value in microseconds.
  */
 double getMovingAverage(int timeCorrection){
 
@@ -380,7 +477,7 @@ double getMovingAverage(int timeCorrection){
 		g.correctionFifoCount += 1;						// the FIFO is full and ready to use.
 	}
 
-	avgCorrection = g.correctionAccum * PER_MINUTE;
+	avgCorrection = (double)g.correctionAccum * PER_MINUTE / (double)g.usecScale;
 	return avgCorrection;
 }
 
@@ -396,7 +493,7 @@ int getNearestSecond(void){
 	int roundedTime;
 	struct timespec t_now;
 
-	clock_gettime(CLOCK_REALTIME, &t_now);
+	clk->getTime(CLOCK_REALTIME, &t_now);
 	roundedTime = (int)round((double)t_now.tv_sec + 1e-9 * (double)t_now.tv_nsec);
 	return roundedTime;
 }
@@ -421,7 +518,8 @@ void setClocktoNISTtime(void){
 	g.t3.time.tv_sec = g.consensusTimeError;
 	g.t3.time.tv_usec = 0;
 
-	int rv = adjtimex(&g.t3);
+	int rv = clk->adjustClock(&g.t3);
+	journalEvent(PPS_EVENT_NIST_CORRECTION, g.consensusTimeError, rv == -1 ? -1 : 0);
 	if (rv == -1){
 		sprintf(g.logbuf, "In setClocktoNISTtime() adjtimex() returned: errno: %d, %s\n", errno, strerror(errno));
 		writeToLog(g.logbuf, "setClocktoNISTtime()");
@@ -460,7 +558,8 @@ void setClockToGPStime(void){
 	g.t3.time.tv_sec = g.serialTimeError;
 	g.t3.time.tv_usec = 0;
 
-	int rv = adjtimex(&g.t3);
+	int rv = clk->adjustClock(&g.t3);
+	journalEvent(PPS_EVENT_SERIAL_CORRECTION, g.serialTimeError, rv == -1 ? -1 : 0);
 	if (rv == -1){
 		sprintf(g.logbuf, "adjtimex() returned: errno: %d, %s\n", errno, strerror(errno));
 		writeToLog(g.logbuf, "setClockToGPStime()");
@@ -480,6 +579,69 @@ void setClockToGPStime(void){
 }
 
 
+/**
+ * Adds a sample to bin idx of a decaying distribution.
+ *
+ * A decaying distribution is decayed lazily: rather than
+ * scaling every bin at each decay step, decayDistrib()
+ * raises the weight with which new samples are added, so
+ * each sample is a single add. The value of bin i is
+ * bins[i] / weight, which normalizeDistrib() restores to
+ * a weight of 1 when the weight grows large. A weight of
+ * zero, as left by initialize(), is taken to be 1.
+ *
+ * @param[in,out] bins The distribution.
+ * @param[in,out] weight The weight of a new sample.
+ * @param[in] idx The bin of the sample.
+ */
+void addDecayingSample(double *bins, double *weight, int idx){
+	if (*weight == 0.0){
+		*weight = 1.0;
+	}
+	bins[idx] += *weight;
+}
+
+/**
+ * Rescales a decaying distribution so that the weight
+ * of a new sample is 1.
+ *
+ * @param[in,out] bins The distribution.
+ * @param[in] len The number of bins.
+ * @param[in,out] weight The weight of a new sample.
+ */
+void normalizeDistrib(double *bins, int len, double *weight){
+	if (*weight == 0.0){
+		return;
+	}
+	double scale = 1.0 / *weight;
+	for (int i = 0; i < len; i++){
+		bins[i] *= scale;
+	}
+	*weight = 1.0;
+}
+
+/**
+ * Decays the samples already in a decaying distribution
+ * by the factor decay relative to the samples that follow.
+ * The bins are rescaled only when the weight of a new
+ * sample reaches DECAY_WEIGHT_MAX.
+ *
+ * @param[in,out] bins The distribution.
+ * @param[in] len The number of bins.
+ * @param[in,out] weight The weight of a new sample.
+ * @param[in] decay The decay factor.
+ */
+void decayDistrib(double *bins, int len, double *weight, double decay){
+	if (*weight == 0.0){
+		*weight = 1.0;
+	}
+	*weight /= decay;
+
+	if (*weight > DECAY_WEIGHT_MAX){
+		normalizeDistrib(bins, len, weight);
+	}
+}
+
 /**
  * Constructs an exponentially decaying distribution
  * of rawError with a half life on individual samples
@@ -487,9 +649,10 @@ void setClockToGPStime(void){
  *
  * @param[in] rawError The distribution values.
  * @param[out] errorDistrib The distribution being constructed.
+ * @param[in,out] weight The weight of a new sample in errorDistrib.
  * @param[in,out] count The count of distribution samples.
  */
-void buildRawErrorDistrib(int rawError, double errorDistrib[], unsigned int *count){
+void buildRawErrorDistrib(int rawError, double errorDistrib[], double *weight, unsigned int *count){
 	int len = ERROR_DISTRIB_LEN - 1;
 
 	int idx = rawError + RAW_ERROR_ZERO;
@@ -502,13 +665,10 @@ void buildRawErrorDistrib(int rawError, double errorDistrib[], unsigned int *cou
 
 	if (g.hardLimit == HARD_LIMIT_1){
 
-		if (*count > 600 && *count % 60 == 0){						// About once a minute
-
-			for (int i = 0; i < len; i++){							// Scale errorDistrib to allow older
-				errorDistrib[i] *= RAW_ERROR_DECAY;					// values to decay (halflife 1 hour).
-			}
+		if (*count > 600 && *count % 60 == 0){						// About once a minute allow older
+			decayDistrib(errorDistrib, ERROR_DISTRIB_LEN, weight, RAW_ERROR_DECAY);	// values to decay (halflife 1 hour).
 		}
-		errorDistrib[idx] += 1.0;
+		addDecayingSample(errorDistrib, weight, idx);
 	}
 
 	*count += 1;
@@ -522,8 +682,8 @@ void buildRawErrorDistrib(int rawError, double errorDistrib[], unsigned int *cou
  * @param[in] rawError The fractional second time of arrival
  * of the PPS.
  */
-void getAvgNoiseLevel(int rawError){
-	double diff = ((double)rawError - rawErrorAvg) * NOISE_ACCUM_RATE;
+void getAvgNoiseLevel(double rawError){
+	double diff = (rawError - rawErrorAvg) * NOISE_ACCUM_RATE;
 	rawErrorAvg += diff;
 
 	double absdiff = ((double)abs(g.jitter) - g.noiseLevel) * NOISE_ACCUM_RATE;
@@ -596,45 +756,71 @@ bool detectDelaySpike(int rawError){
  * then translates the value.
  *
  * @param[in] fracSec The delayed time of
- * the PPS rising edge returned by the system clock.
+ * the PPS rising edge returned by the system clock
+ * in units of 1/G.usecScale microseconds.
  *
  * @returns The signed fractional seconds part of the time.
  */
 int signedFractionalSeconds(int fracSec){
 
-	if (fracSec > 500000){
-		fracSec -= USECS_PER_SEC;
+	if (fracSec > (USECS_PER_SEC / 2) * g.usecScale){
+		fracSec -= USECS_PER_SEC * g.usecScale;
 	}
 	return fracSec;
 }
 
+/**
+ * Converts a controller error value to the
+ * nearest whole microsecond.
+ *
+ * @param[in] val The value in units of 1/G.usecScale
+ * microseconds.
+ *
+ * @returns The value in microseconds.
+ */
+static inline int toUsec(int val){
+	if (g.usecScale == 1){
+		return val;
+	}
+	return (val >= 0) ? (val + g.usecScale / 2) / g.usecScale
+			: (val - g.usecScale / 2) / g.usecScale;
+}
+
 /**
  * Removes delay spikes and jitter from rawError and
  * returns the resulting clamped zeroError.
  *
- * @param[in] rawError The raw error value to be processed.
+ * In nanosecond mode only the clamping is done at
+ * nanosecond resolution. Delay spike detection, the
+ * noise statistics and the distributions work on the
+ * error rounded to the nearest microsecond.
+ *
+ * @param[in] rawError The raw error value to be processed
+ * in units of 1/G.usecScale microseconds.
  *
  * @returns The resulting zeroError value.
  */
 int removeNoise(int rawError){
 
 	int zeroError;
+	int rawErrorUsec = toUsec(rawError);
 
-	buildRawErrorDistrib(rawError, g.rawErrorDistrib, &(g.ppsCount));
+	buildRawErrorDistrib(rawErrorUsec, g.rawErrorDistrib, &(g.rawErrorWeight), &(g.ppsCount));
 
 //	if (rawError < -1000){
 //		g.jitter = 1000000 + rawError;
 //	}
 //	else {
-		g.jitter = rawError;
+		g.jitter = rawErrorUsec;
 //	}
+	addStatsSample(&jitterSketch, (double)rawError / (double)g.usecScale);
 
-	g.isDelaySpike = detectDelaySpike(rawError);
+	g.isDelaySpike = detectDelaySpike(rawErrorUsec);
 
-	getTimeSlew(rawError);
+	getTimeSlew(rawErrorUsec);
 
 	if (writeJitterDistrib && g.seq_num > SETTLE_TIME){
-		buildJitterDistrib(rawError);
+		buildJitterDistrib(rawErrorUsec);
 	}
 
 	if (g.isDelaySpike){
@@ -646,7 +832,7 @@ int removeNoise(int rawError){
 	zeroError = clampJitter(rawError);				// Recover the time error by
 													// limiting away the jitter.
 	if (g.clampAbsolute == true){
-		getAvgNoiseLevel(zeroError);
+		getAvgNoiseLevel((double)zeroError / (double)g.usecScale);
 	}
 
 	if (g.isControlling){
@@ -654,7 +840,7 @@ int removeNoise(int rawError){
 	}
 
 	if (g.seq_num > SETTLE_TIME && writeErrorDistrib){
-		buildErrorDistrib(zeroError);
+		buildErrorDistrib(toUsec(zeroError));
 	}
 
 	return zeroError;
@@ -693,26 +879,23 @@ double getIntegral(void){
  *
  * @param[in] timeCorrection The correction to
  * be applied to get the time of the PPS rising
- * edge.
+ * edge in units of 1/G.usecScale microseconds.
  */
 void savePPStime(int timeCorrection){
 
-	struct timeval tv1;
-	gettimeofday(&tv1, NULL);					// Will always be after rollover of second
+	struct timespec tv1;
+	clk->getTime(CLOCK_REALTIME, &tv1);			// Will always be after rollover of second
 
 	g.pps_t_sec = tv1.tv_sec;					// So the unmodified second will be correct
 
-	g.pps_t_usec = -timeCorrection;
-	if (g.pps_t_usec < 0){
-		g.pps_t_usec = 1000000 - timeCorrection;
+	int nsec = -timeCorrection * (NSECS_PER_USEC / g.usecScale);
+	if (nsec < 0){
+		nsec += NSECS_PER_SEC;
 		g.pps_t_sec -= 1;
 	}
+	g.pps_t_usec = nsec / NSECS_PER_USEC;
 
-	double timestamp = (double)g.pps_t_sec + 1e-6 * (double)g.pps_t_usec;
-
-//	printf("\ntimestamp: %lf timeCorrection: %d\n", timestamp, timeCorrection);
-
-	writeTimestamp(timestamp);
+	publishTimestamp(g.pps_t_sec, nsec);
 }
 
 /**
@@ -736,7 +919,7 @@ void detectMissedPPS(void){
 		}
 	}
 
-	clock_gettime(CLOCK_MONOTONIC, &t_mono);
+	clk->getTime(CLOCK_MONOTONIC, &t_mono);
 	g.t_mono_now = (double)t_mono.tv_sec + 1e-9 * (double)t_mono.tv_nsec;
 
 	if (g.seq_num < 2 || g.startingFromRestore != 0){	// Initialize g.t_mono_last to
@@ -753,6 +936,7 @@ void detectMissedPPS(void){
 	if (iDiff > 1){
 		sprintf(g.logbuf, "detectMissedPPS(): Missed PPS %d time(s)\n", iDiff-1);
 		writeToLog(g.logbuf, "detectMissedPPS()");
+		journalEvent(PPS_EVENT_MISSED_PPS, iDiff - 1, 0);
 	}
 
 	g.t_count += iDiff;								// The counter is advanced only if monotonic clock advanced.
@@ -782,6 +966,7 @@ bool detectExteralSystemClockChange(struct timeval pps_t){
 			int change = g.t_now - g.t_count;
 			sprintf(g.logbuf, "detectExteralSystemClockChange() System time changed externally by %d seconds\n", change);
 			writeToLog(g.logbuf, "detectExteralSystemClockChange()");
+			journalEvent(PPS_EVENT_CLOCK_CHANGED, change, 0);
 
 			clockChanged = true;     						// The clock was set externally.
 			g.t_count = g.t_now;							// Update the seconds counter.
@@ -791,6 +976,7 @@ bool detectExteralSystemClockChange(struct timeval pps_t){
 
 			sprintf(g.logbuf, "detectExteralSystemClockChange() Error in fractional second of %ld microseconds\n", pps_t.tv_usec);
 			writeToLog(g.logbuf, "detectExteralSystemClockChange()");
+			journalEvent(PPS_EVENT_FRACTIONAL_ERROR, pps_t.tv_usec, 0);
 
 			clockChanged = true;     						// The clock was set externally.
 			g.t_count = g.t_now;							// Update the seconds counter.
@@ -858,7 +1044,7 @@ void setClockFractionalSecond(int correction){			// The correction is always a p
 	g.t_now = (int)g.t3.time.tv_sec;					// Reconcile the g.t_count monotonic counter to prevent
 	g.t_count = g.t_now;								// triggering detectExteralSystemClockChange().
 
-	int rv = adjtimex(&g.t3);
+	int rv = clk->adjustClock(&g.t3);
 	if (rv == -1){
 		sprintf(g.logbuf, "adjtimex() returned: errno: %d, %s\n", errno, strerror(errno));
 		writeToLog(g.logbuf, "setClockFractionalSecond()");
@@ -893,6 +1079,7 @@ int correctFractionalSecond(struct timeval *pps_t){
 	}
 
 	setClockFractionalSecond(correction);
+	journalEvent(PPS_EVENT_FRACTIONAL_CORRECTION, relCorrection, 0);
 
 	pps_t->tv_usec = pps_t->tv_usec - correction;				// Correct the interrut delay time that will be processed.
 
@@ -947,7 +1134,9 @@ void doTimeFixups(struct timeval pps_t){
 
 		g.blockDetectClockChange = SECS_PER_MINUTE;				// Block detectExteralSystemClockChange() for one minute
 																// after it has been triggered.
-		sysCommand("systemctl stop systemd-timesyncd.service");	// If systemctl was used to set the system time, kill it.
+		if (clk->ownsSystemClock){
+			sysCommand("systemctl stop systemd-timesyncd.service");	// If systemctl was used to set the system time, kill it.
+		}
 	}
 	else if (g.blockDetectClockChange > SECS_PER_MINUTE - 4){
 		correctFractionalSecond(&pps_t);						// Continue fixing the fractional seconds for awhile.
@@ -974,24 +1163,35 @@ void doTimeFixups(struct timeval pps_t){
  * This function is called by readPPS_SetTime() from within the
  * one-second delay loop in the waitForPPS() function.
  *
+ * In nanosecond mode the error and correction values carry
+ * nanoseconds. Because ADJ_OFFSET_SINGLESHOT takes only whole
+ * microseconds, the part of each correction that can not be
+ * applied is carried in G.correctionResidual and added to the
+ * next correction so that the average applied correction keeps
+ * nanosecond resolution.
+ *
  * @param[in] pps_t The delayed time of the PPS rising
  * edge returned by the system clock.
  *
  * @returns 0 on success else -1 on system error.
  */
-int makeTimeCorrection(struct timeval pps_t){
+int makeTimeCorrection(struct timespec pps_t){
 
 	g.interruptReceived = true;
 
 	g.seq_num += 1;
 
 	if (g.isControlling && g.startingFromRestore == 0){
-		doTimeFixups(pps_t);
+		struct timeval pps_tv;
+		pps_tv.tv_sec = pps_t.tv_sec;
+		pps_tv.tv_usec = pps_t.tv_nsec / NSECS_PER_USEC;
+
+		doTimeFixups(pps_tv);
 	}
 
-	g.ppsTimestamp = (int)pps_t.tv_usec;
+	g.ppsTimestamp = (int)(pps_t.tv_nsec / (NSECS_PER_USEC / g.usecScale));
 
-	int time0 = g.ppsTimestamp - g.zeroOffset;
+	int time0 = g.ppsTimestamp - g.zeroOffset * g.usecScale;
 
     g.rawError = signedFractionalSeconds(time0);        // g.rawError is set to zero by the feedback loop causing
     													// pps_t.tv_usec == g.zeroOffset so that the timestamp
@@ -1001,15 +1201,23 @@ int makeTimeCorrection(struct timeval pps_t){
 		savePPStime(0);
 		return 0;
 	}
+	if (g.isControlling){
+		recordStability(pps_t.tv_sec, (double)g.rawError / (double)g.usecScale);
+	}
 
 	g.timeCorrection = -g.zeroError						// The sign of g.zeroError is chosen to provide negative feedback.
 				/ g.invProportionalGain;				// Apply controller proportional gain factor.
+	addStatsSample(&correctionSketch, (double)g.timeCorrection / (double)g.usecScale);
+
+	g.correctionResidual += g.timeCorrection;
+	int offset = toUsec(g.correctionResidual);
+	g.correctionResidual -= offset * g.usecScale;
 
 	g.t3.status = 0;
 	g.t3.modes = ADJ_OFFSET_SINGLESHOT;
-	g.t3.offset = g.timeCorrection;
+	g.t3.offset = offset;
 
-	adjtimex(&g.t3);
+	clk->adjustClock(&g.t3);
 
 	g.isControlling = getAcquireState();				// Provides enough time to reduce time slew on startup.
 	if (g.isControlling){
@@ -1018,17 +1226,20 @@ int makeTimeCorrection(struct timeval pps_t){
 
 		makeAverageIntegral(g.avgCorrection);			// Constructs an average of integrals of one
 														// minute rolling averages of time corrections.
-		if (integralIsReady()){							// Get a new frequency offset.
+		bool isIntegralUpdate = integralIsReady();
+		if (isIntegralUpdate){							// Get a new frequency offset.
 			g.integralTimeCorrection = getIntegral();
+			foldThermalCorrection();
 			g.freqOffset = g.integralTimeCorrection * g.integralGain;
 
 			g.t3.status = 0;
 			g.t3.modes = ADJ_FREQUENCY;
 			g.t3.freq = (long)round(ADJTIMEX_SCALE * g.freqOffset);
-			adjtimex(&g.t3);							// Adjust the system clock frequency.
+			clk->adjustClock(&g.t3);					// Adjust the system clock frequency.
 		}
+		thermalFeedforward(isIntegralUpdate);			// Between updates, follow the CPU temperature.
 
-		recordOffsets(g.timeCorrection);
+		recordOffsets(toUsec(g.timeCorrection));
 
 		g.activeCount += 1;
 	}
@@ -1056,6 +1267,7 @@ int checkPPSInterrupt(void){
 			if (g.interruptLossCount == INTERRUPT_LOST){
 				sprintf(g.logbuf, "WARNING: PPS interrupt lost\n");
 				writeToLog(g.logbuf, "checkPPSInterrupt()");
+				journalEvent(PPS_EVENT_PPS_LOST, g.interruptLossCount, 0);
 			}
 			if (g.exitOnLostPPS &&  g.interruptLossCount >= SECS_PER_HOUR){
 				sprintf(g.logbuf, "ERROR: Lost PPS for one hour.");
@@ -1067,6 +1279,7 @@ int checkPPSInterrupt(void){
 			if (g.interruptLossCount >= INTERRUPT_LOST){
 				sprintf(g.logbuf, "PPS interrupt resumed\n");
 				writeToLog(g.logbuf, "checkPPSInterrupt()");
+				journalEvent(PPS_EVENT_PPS_RESUMED, g.interruptLossCount, 0);
 			}
 			g.interruptLossCount = 0;
 		}
@@ -1078,37 +1291,339 @@ int checkPPSInterrupt(void){
 }
 
 /**
- * Sets a nanosleep() time delay equal to the time remaining
- * in the second from the time recorded as fracSec plus an
- * adjustment value of timeAt in microseconds.
+ * Converts a timespec to nanoseconds.
+ */
+static inline int64_t timespecToNs(const struct timespec *ts){
+	return (int64_t)ts->tv_sec * NSECS_PER_SEC + ts->tv_nsec;
+}
+
+/**
+ * Records the current offset between CLOCK_REALTIME
+ * and CLOCK_MONOTONIC. Both clocks are slewed together
+ * by adjtimex() so the offset changes only when the
+ * system time is set.
  *
- * @param[in] timeAt The adjustment value in microseconds.
+ * @returns The current CLOCK_REALTIME in nanoseconds.
+ */
+static int64_t anchorSyncTimer(void){
+	struct timespec t_rt, t_mono;
+
+	clk->getTime(CLOCK_MONOTONIC, &t_mono);
+	clk->getTime(CLOCK_REALTIME, &t_rt);
+
+	st.realtimeOffset = timespecToNs(&t_rt) - timespecToNs(&t_mono);
+	st.isAnchored = true;
+
+	return timespecToNs(&t_rt);
+}
+
+/**
+ * Arms the timerfd that is cancelled by the kernel
+ * whenever CLOCK_REALTIME is set discontinuously.
  *
- * @param[in] fracSec The fractional second part of
- * the system time in microseconds.
+ * @returns 0 on success else -1 on error.
+ */
+static int armClockSetTimer(void){
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(struct itimerspec));
+	its.it_value.tv_sec = 0x7fffffff;					// Far future. Never expires.
+
+	return timerfd_settime(st.clockSetFd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL);
+}
+
+/**
+ * Polls, without blocking, for a discontinuous change
+ * to CLOCK_REALTIME since the last call. Such a change
+ * is made by adjtimex(ADJ_SETOFFSET) in this program or
+ * by any external program that sets the system time.
  *
- * @returns The length of time to sleep in seconds and nanoseconds.
+ * @returns "true" if the system time was set, else "false".
  */
-struct timespec setSyncDelay(int timeAt, int fracSec){
+static bool realtimeWasSet(void){
+	struct pollfd pfd;
+	uint64_t expirations;
 
-	struct timespec ts2;
+	if (st.clockSetFd == -1){
+		return false;
+	}
 
-	int timerVal = USECS_PER_SEC - fracSec + timeAt;
+	pfd.fd = st.clockSetFd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
 
-	if (timerVal >= USECS_PER_SEC){
-		ts2.tv_sec = 1;
-		ts2.tv_nsec = (timerVal - USECS_PER_SEC) * 1000;
+	if (poll(&pfd, 1, 0) <= 0){
+		return false;
 	}
-	else if (timerVal < 0){
-		ts2.tv_sec = 0;
-		ts2.tv_nsec = (USECS_PER_SEC + timerVal) * 1000;
+
+	if (read(st.clockSetFd, &expirations, sizeof(uint64_t)) == -1 && errno == ECANCELED){
+		armClockSetTimer();								// Cancelled timers must be re-armed.
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Creates the timerfd used to detect changes to the
+ * system time and anchors the waitForPPS() deadlines
+ * to the current time.
+ *
+ * @returns 0 on success else -1 on error.
+ */
+int initSyncTimer(void){
+
+	st.clockSetFd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (st.clockSetFd == -1){
+		sprintf(g.logbuf, "initSyncTimer(): timerfd_create() failed. Error: %s\n", strerror(errno));
+		writeToLog(g.logbuf, "initSyncTimer()");
+		return -1;
+	}
+
+	if (armClockSetTimer() == -1){
+		sprintf(g.logbuf, "initSyncTimer(): timerfd_settime() failed. Error: %s\n", strerror(errno));
+		writeToLog(g.logbuf, "initSyncTimer()");
+		close(st.clockSetFd);
+		st.clockSetFd = -1;
+		return -1;
+	}
+
+	st.isAnchored = false;
+	st.ppsReceived = false;
+	return 0;
+}
+
+/**
+ * Releases the timerfd created by initSyncTimer().
+ */
+void freeSyncTimer(void){
+	if (st.clockSetFd != -1){
+		close(st.clockSetFd);
+		st.clockSetFd = -1;
+	}
+}
+
+/**
+ * Sets the absolute CLOCK_MONOTONIC time at which
+ * waitForPPS() next wakes to look for the PPS. The
+ * target is timeAt microseconds from the rollover of
+ * the second that follows the last PPS, taken as the
+ * nearest second to its timestamp so that a PPS stamped
+ * just before the rollover does not set a deadline
+ * that has already passed.
+ *
+ * Because the deadline is absolute it does not drift
+ * as adjtimex() slews the clock, and no system time
+ * read is needed except when the system time has been
+ * set or no PPS has yet been seen. If no PPS was
+ * received in the last second the deadline advances
+ * by exactly one second.
+ *
+ * @param[in] timeAt The adjustment value in microseconds.
+ */
+void setNextWakeTime(int timeAt){
+	int64_t timeAt_ns = (int64_t)timeAt * 1000;
+
+	if (realtimeWasSet() || st.isAnchored == false){
+		int64_t t_now = anchorSyncTimer();
+		int64_t target = (t_now / NSECS_PER_SEC + 1) * NSECS_PER_SEC + timeAt_ns;
+		if (target <= t_now){
+			target += NSECS_PER_SEC;
+		}
+		st.wakeTime = target - st.realtimeOffset;
+	}
+	else if (st.ppsReceived){
+		st.wakeTime = ((int64_t)st.ppsSec + 1) * NSECS_PER_SEC + timeAt_ns - st.realtimeOffset;
 	}
 	else {
-		ts2.tv_sec = 0;
-		ts2.tv_nsec = timerVal * 1000;
+		st.wakeTime += NSECS_PER_SEC;
 	}
 
-	return ts2;
+	st.ppsReceived = false;
+}
+
+/**
+ * Sleeps until the deadline set by setNextWakeTime()
+ * and passes the lateness of the wakeup to
+ * updatePPSWindow().
+ *
+ * Returns immediately if the deadline has already
+ * passed, as when the work of the last second overran
+ * it. The lateness of such a wakeup measures that work
+ * rather than the timer, so it is counted separately
+ * and is not passed to updatePPSWindow().
+ */
+void sleepUntilWakeTime(void){
+	struct timespec ts, t_mono;
+	int rv;
+
+	clk->getTime(CLOCK_MONOTONIC, &t_mono);
+	st.isLate = (timespecToNs(&t_mono) >= st.wakeTime);
+	if (st.isLate){
+		st.missedDeadlines += 1;
+		return;
+	}
+
+	ts.tv_sec = (time_t)(st.wakeTime / NSECS_PER_SEC);
+	ts.tv_nsec = (long)(st.wakeTime % NSECS_PER_SEC);
+
+	do {
+		rv = clk->sleepUntil(CLOCK_MONOTONIC, &ts);
+	} while (rv == EINTR && g.exit_requested == false);
+
+	clk->getTime(CLOCK_MONOTONIC, &t_mono);
+	updatePPSWindow((int)((timespecToNs(&t_mono) - st.wakeTime) / 1000));
+}
+
+/**
+ * Returns the current adaptive PPS window in microseconds.
+ */
+int getPPSWindow(void){
+	return st.window;
+}
+
+/**
+ * Gets the wakeup lateness at quantile LATENESS_QUANTILE
+ * of the decaying lateness distribution.
+ *
+ * @returns The upper edge in microseconds of the bin
+ * containing the quantile.
+ */
+static int getLatenessQuantile(void){
+	double total = 0.0;
+
+	for (int i = 0; i < LATENESS_DISTRIB_LEN; i++){
+		total += st.latenessDistrib[i];
+	}
+
+	double target = total * LATENESS_QUANTILE;
+	double sum = 0.0;
+	int i;
+	for (i = 0; i < LATENESS_DISTRIB_LEN - 1; i++){
+		sum += st.latenessDistrib[i];
+		if (sum >= target){
+			break;
+		}
+	}
+	return (i + 1) * LATENESS_BIN_USEC;
+}
+
+/**
+ * Sizes the PPS window, the lead with which waitForPPS()
+ * wakes before the expected PPS, from the lateness of
+ * each wakeup relative to its deadline.
+ *
+ * Too small a window loses the PPS of any second in which
+ * the wakeup is later than the PPS. Too large a window
+ * spends the difference waiting in time_pps_fetch(). So
+ * the window is kept PPS_WINDOW_MARGIN above a high
+ * quantile of a decaying distribution of the lateness.
+ * The window grows at once to cover a wakeup later than
+ * the window allows, but shrinks only with the quantile,
+ * which is updated once a minute after the distribution
+ * has ten minutes of wakeups.
+ *
+ * @param[in] lateness Microseconds by which the wakeup
+ * followed its deadline.
+ */
+void updatePPSWindow(int lateness){
+
+	if (lateness < 0){									// Interrupted by an exit request
+		return;
+	}
+
+	int idx = lateness / LATENESS_BIN_USEC;
+	if (idx > LATENESS_DISTRIB_LEN - 1){
+		idx = LATENESS_DISTRIB_LEN - 1;
+	}
+	addDecayingSample(st.latenessDistrib, &st.latenessWeight, idx);
+	st.latenessCount += 1;
+
+	if (lateness + PPS_WINDOW_MARGIN > st.window){
+		st.window = lateness + PPS_WINDOW_MARGIN;
+		if (st.window > PPS_WINDOW_MAX){
+			st.window = PPS_WINDOW_MAX;
+		}
+	}
+
+	if (st.latenessCount % SECS_PER_MINUTE == 0){
+		decayDistrib(st.latenessDistrib, LATENESS_DISTRIB_LEN, &st.latenessWeight, LATENESS_DECAY);
+		st.lateness = getLatenessQuantile();
+
+		if (st.latenessCount >= SECS_PER_10_MIN){
+			int window = st.lateness + PPS_WINDOW_MARGIN;
+			if (window < PPS_WINDOW_MIN){
+				window = PPS_WINDOW_MIN;
+			}
+			else if (window > PPS_WINDOW_MAX){
+				window = PPS_WINDOW_MAX;
+			}
+			st.window = window;
+		}
+	}
+}
+
+/**
+ * Starts the phase latency timing of this second
+ * on waking from sleepUntilWakeTime(). Phases not
+ * reached this second are left at -1.
+ */
+void startPhaseTiming(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	g.phaseStart = (int64_t)ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+
+	for (int i = 0; i < PPS_NUM_PHASES; i++){
+		g.phaseUsec[i] = -1;
+	}
+}
+
+/**
+ * Records the time in microseconds from the wakeup
+ * of this second to the end of a phase.
+ *
+ * @param[in] phase The PPS_PHASE_ that has ended.
+ */
+void markPhase(int phase){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	int64_t t = (int64_t)ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+	g.phaseUsec[phase] = (int)((t - g.phaseStart) / 1000);
+}
+
+/**
+ * Adds the phase latencies of this second to the
+ * phase latency distributions and to the latency
+ * summary published in the status block. The phase
+ * latencies of a second whose deadline had passed
+ * before the sleep are not added because they were
+ * not timed from the start of the PPS window.
+ */
+void recordPhaseLatencies(void){
+	struct ppsPhaseLatency *lat = &g.phaseLatency;
+
+	for (int i = 0; i < PPS_NUM_PHASES && st.isLate == false; i++){
+		int usec = g.phaseUsec[i];
+		if (usec < 0){
+			continue;
+		}
+
+		int idx = usec / PHASE_BIN_USEC;
+		if (idx > PHASE_DISTRIB_LEN - 1){
+			idx = PHASE_DISTRIB_LEN - 1;
+		}
+		g.phaseDistrib[i][idx] += 1;
+
+		lat->count[i] += 1;
+		lat->last[i] = usec;
+		if (usec > lat->max[i]){
+			lat->max[i] = usec;
+		}
+	}
+	lat->window = st.window;
+	lat->lateness = st.lateness;
+	lat->missed = st.missedDeadlines;
 }
 
 /**
@@ -1140,7 +1655,8 @@ struct timespec setSyncDelay(int timeAt, int fracSec){
 int readPPS_SetTime(bool verbose, timeCheckParams *tcp, pps_handle_t *pps_handle, int *pps_mode){
 	int restart = 0;
 
-	int rv = readPPSTimestamp(pps_handle, pps_mode, g.tm);
+	int rv = clk->fetchPPS(pps_handle, pps_mode, &g.t);
+	markPhase(PPS_PHASE_FETCH);
 
 	detectMissedPPS();
 
@@ -1158,12 +1674,15 @@ int readPPS_SetTime(bool verbose, timeCheckParams *tcp, pps_handle_t *pps_handle
 			writeToLog(g.logbuf, "readPPS_SetTime()");
 		}
 		g.interruptLost = true;
+
+		if (st.window < PPS_WINDOW_MAX){		// The PPS may have preceded the wakeup.
+			st.window = (2 * st.window < PPS_WINDOW_MAX) ? 2 * st.window : PPS_WINDOW_MAX;
+		}
 	}
 	else {
 
-		g.t.tv_sec = g.tm[0];					// Seconds value read by gps-pps-io driver from system clock
-												// at rising edge of PPS signal.
-		g.t.tv_usec = g.tm[1];					// Fractional seconds read from the timestamp of the PPS signal
+		st.ppsSec = g.t.tv_sec + (g.t.tv_nsec > NSECS_PER_SEC / 2);	// The PPS may be stamped just before the rollover.
+		st.ppsReceived = true;										// Retained for setNextWakeTime() across a restart.
 
 		rv = makeTimeCorrection(g.t);
 		if (rv == -1){
@@ -1171,6 +1690,7 @@ int readPPS_SetTime(bool verbose, timeCheckParams *tcp, pps_handle_t *pps_handle
 			writeToLog(g.logbuf, "readPPS_SetTime()");
 			return -1;
 		}
+		markPhase(PPS_PHASE_CORRECTION);
 
 		if (g.startingFromRestore == 0){
 
@@ -1180,6 +1700,7 @@ int readPPS_SetTime(bool verbose, timeCheckParams *tcp, pps_handle_t *pps_handle
 
 				sprintf(g.logbuf, "pps-client is restarting from SLEW_MAX...\n");
 				writeToLog(g.logbuf, "readPPS_SetTime() 1");
+				journalEvent(PPS_EVENT_RESTART, g.avgSlew, 0);
 
 				initialize(verbose);				// then restart the controller.
 
@@ -1191,6 +1712,7 @@ int readPPS_SetTime(bool verbose, timeCheckParams *tcp, pps_handle_t *pps_handle
 
 				sprintf(g.logbuf, "pps-client is restarting from restore...\n");
 				writeToLog(g.logbuf, "readPPS_SetTime() 2");
+				journalEvent(PPS_EVENT_RESTART, g.avgSlew, 1);
 
 				initialize(verbose);				// then restart the controller.
 				restart = 1;
@@ -1246,6 +1768,10 @@ int readPPS_SetTime(bool verbose, timeCheckParams *tcp, pps_handle_t *pps_handle
  * timestamp of the interrupt which is passed to
  * makeTimeCorrection().
  *
+ * Each wakeup is an absolute CLOCK_MONOTONIC deadline
+ * from setNextWakeTime() so that the wakeup time does not
+ * drift while adjtimex() slews the system clock.
+ *
  * @param[in] verbose If "true" then write pps-client
  * state status messages to the console. Else not.
  *
@@ -1254,8 +1780,6 @@ int readPPS_SetTime(bool verbose, timeCheckParams *tcp, pps_handle_t *pps_handle
  *
  */
 void waitForPPS(bool verbose, pps_handle_t *pps_handle, int *pps_mode){
-	struct timeval tv1;
-	struct timespec ts2;
 	int timePPS;
 	int rv;
 	timeCheckParams tcp;
@@ -1291,6 +1815,41 @@ void waitForPPS(bool verbose, pps_handle_t *pps_handle, int *pps_mode){
 										// Set up a one-second delay loop that stays in synch by
 	timePPS = -PPS_WINDOW;		    	// continuously re-timing to before the roll-over of the second.
 										// timePPS allows for a time window in which to look for the PPS
+	if (initSyncTimer() == -1){
+		goto end;
+	}
+
+	if (startWriterThread() == -1){			// File writes are made by the writer thread from here.
+		goto end;
+	}
+
+	if (initTimestampShm() == -1){
+		goto end;
+	}
+
+	if (initStatusShm() == -1){
+		goto end;
+	}
+
+	if (initHistory() == -1){				// The controller runs without the history store.
+		sprintf(g.logbuf, "The history of time corrections will not be recorded.\n");
+		writeToLog(g.logbuf, "waitForPPS() 1");
+	}
+
+	if (initJournal() == -1){				// The controller runs without the event journal.
+		sprintf(g.logbuf, "Controller events will not be journaled.\n");
+		writeToLog(g.logbuf, "waitForPPS()");
+	}
+	journalEvent(PPS_EVENT_START, 0, 0);
+
+	if (startControlThread() == -1){
+		goto end;
+	}
+
+	if (startConfigWatcher() == -1){
+		goto end;
+	}
+
 	writeStatusStrings();
 
 	for (;;){							// Look for the PPS time returned by the PPS driver
@@ -1314,15 +1873,18 @@ void waitForPPS(bool verbose, pps_handle_t *pps_handle, int *pps_mode){
 		g.isVerbose = verbose;
 
 		if (g.exit_requested){
+			sprintf(g.logbuf, "Recieved SIGTERM\n");
+			writeToLog(g.logbuf, "waitForPPS() 2");
+
 			sprintf(g.logbuf, "PPS-Client stopped.\n");
 			writeToLog(g.logbuf, "waitForPPS() 2");
 			break;
 		}
 
-		gettimeofday(&tv1, NULL);
-		ts2 = setSyncDelay(timePPS, tv1.tv_usec);
-
-		nanosleep(&ts2, NULL);			// Sleep until ready to look for PPS interrupt
+		timePPS = -st.window;			// The adaptive PPS window
+		setNextWakeTime(timePPS);
+		sleepUntilWakeTime();			// Sleep until ready to look for PPS interrupt
+		startPhaseTiming();
 
 		restart = readPPS_SetTime(verbose, &tcp, pps_handle, pps_mode);
 		if (restart == -1){
@@ -1361,12 +1923,18 @@ void waitForPPS(bool verbose, pps_handle_t *pps_handle, int *pps_mode){
 			}
 
 			writeStatusStrings();
+			markPhase(PPS_PHASE_STATUS);
 
 			if (! g.interruptLost && ! g.isDelaySpike){
 				if (getConfigs() == -1){
 					break;
 				}
+				markPhase(PPS_PHASE_CONFIG);
 			}
+
+			checkpointState();			// Written by the writer thread
+
+			recordPhaseLatencies();		// A restart clears the distributions along with the other controller state.
 		}
 
 //		if (verbose){
@@ -1377,6 +1945,17 @@ void waitForPPS(bool verbose, pps_handle_t *pps_handle, int *pps_mode){
 	saveLastState();
 
 end:
+	stopConfigWatcher();
+	stopControlThread();
+	journalEvent(PPS_EVENT_EXIT, 0, 0);
+	stopWriterThread();						// Finishes the queued stores into the mapped files.
+	saveDriftModel(g.logbuf);
+	freeJournal();
+	freeHistory();
+	freeStatusShm();
+	freeTimestampShm();
+	freeSyncTimer();
+
 	if (g.doNISTsettime){
 		freeNISTThreads(&tcp);
 	}
@@ -1410,6 +1989,7 @@ end:
  * If the -s flag is not followed by a file specifier,
  * a list of the files that can be saved is printed.
  */
+#ifndef PPS_SIM
 int main(int argc, char *argv[])
 {
 	int rv = 0;
@@ -1484,4 +2064,4 @@ int main(int argc, char *argv[])
 end0:
 	return rv;
 }
-
+#endif /* PPS_SIM */
@@ -41,10 +41,17 @@
 #include <errno.h>
 #include <poll.h>
 #include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "timepps.h"
+#include "pps-shm.h"
+#include "pps-journal.h"
 #include <inttypes.h>
 
 #define USECS_PER_SEC 1000000
+#define NSECS_PER_SEC 1000000000
+#define NSECS_PER_USEC 1000
 #define SECS_PER_MINUTE 60
 #define SECS_PER_5_MIN 300
 #define SECS_PER_10_MIN 600
@@ -58,8 +65,14 @@
 #define INV_GAIN_0 4						//!< Controller inverse proportional gain constant at startup
 #define INTEGRAL_GAIN 0.63212				//!< Controller integral gain constant in active controller operation
 #define FREQDIFF_INTRVL 5					//!< The number of minutes between Allan deviation samples of system clock frequency correction
-#define PPS_WINDOW 500						//!< WaitForPPS delay loop time window in which to look for a PPS
+#define PPS_WINDOW 500						//!< WaitForPPS delay loop time window in which to look for a PPS. The initial value of the adaptive window.
+#define PPS_WINDOW_MIN 100					//!< Smallest adaptive PPS window in microseconds
+#define PPS_WINDOW_MAX 2000					//!< Largest adaptive PPS window in microseconds
+#define PPS_WINDOW_MARGIN 50				//!< Microseconds by which the PPS window exceeds the wakeup lateness quantile
 #define PTHREAD_STACK_REQUIRED 16384		//!< Stack space requirements for threads
+#define WRITER_STACK_SZ 65536				//!< Stack space for the file writer thread
+#define CTL_STACK_SZ 65536					//!< Stack space for the control socket threads
+#define CONFIG_STACK_SZ 65536				//!< Stack space for the config file watcher thread
 
 #define ZERO_OFFSET_RPI3 7
 #define ZERO_OFFSET_RPI4 4
@@ -72,6 +85,28 @@
 
 #define RAW_ERROR_ZERO  20					//!< Index corresponding to rawError == 0 in \b buildRawErrorDistrib().
 #define RAW_ERROR_DECAY 0.98851				//!< Decay rate for \b G.rawError samples (1 hour half life)
+#define DECAY_WEIGHT_MAX 1e100				//!< Sample weight at which a decaying distribution is renormalized
+#define SKETCH_ALPHA 0.01					//!< Relative accuracy of the quantiles of the quantile sketches
+#define SKETCH_MIN_VALUE 0.001				//!< Smallest magnitude in microseconds that a quantile sketch distinguishes from zero
+#define SKETCH_LEN 1100						//!< Bins for each sign of a quantile sketch. Covers magnitudes up to several seconds.
+#define SKETCH_INTERVAL SECS_PER_10_MIN		//!< Samples in each interval sketch of a statistic
+#define SKETCH_INTERVALS 6					//!< Interval sketches kept for each statistic
+
+#define HISTORY_MAGIC 0x50505348			//!< "PPSH"
+#define HISTORY_VERSION 1
+#define HISTORY_TIERS 4						//!< Resolutions kept by the history store
+#define HISTORY_LEN_1S 3600					//!< One hour of 1 second points
+#define HISTORY_LEN_10S 8640				//!< One day of 10 second points
+#define HISTORY_LEN_5MIN 8640				//!< 30 days of 5 minute points
+#define HISTORY_LEN_1H 8760					//!< One year of 1 hour points
+#define HISTORY_POINTS (HISTORY_LEN_1S + HISTORY_LEN_10S + HISTORY_LEN_5MIN + HISTORY_LEN_1H)
+
+#define STABILITY_TAUS 18					//!< Octave taus of the stability analysis, 1 second to 2^17 seconds
+#define STABILITY_FINE_TAUS 10				//!< Taus up to STABILITY_BLOCK seconds, computed from every second
+#define STABILITY_BLOCK 512					//!< Seconds in a block of the larger taus
+#define STABILITY_FINE_LEN 2048				//!< Running sums kept for the fine taus. A power of 2 above 3 * STABILITY_BLOCK.
+#define STABILITY_COARSE_LEN 1024			//!< Blocks kept for the larger taus. A power of 2 above 3 * 2^(STABILITY_TAUS - STABILITY_FINE_TAUS).
+#define STABILITY_MAX_GAP 60				//!< Longest run of missing seconds filled in by the stability analysis
 
 #define INTERRUPT_LOST 15					//!< Number of consecutive lost interrupts at which a warning starts
 
@@ -88,7 +123,7 @@
 #define LARGE_SPIKE 80						//!< Level above which spikes are are disruptive
 #define NOISE_ACCUM_RATE 0.1				//!< Sets the rate at which \b G.noiseLevel adjusts to \b G.rawError
 #define NOISE_LEVEL_MIN 4					//!< The minimum level at which interrupt delays are delay spikes.
-#define SLEW_LEN 10							//!< The slew accumulator (slewAccum) update interval
+#define SLEW_LEN 10							//!< Length of the sliding window of rawError values from which avgSlew is found
 #define SLEW_MAX 300						//!< Jitter slew value below which the controller will begin to frequency lock.
 
 #define MAX_LINE_LEN 50
@@ -96,12 +131,62 @@
 #define LOGBUF_SZ 1000
 #define MSGBUF_SZ 1000
 #define NIST_MSG_SZ 200
+#define STATUS_LINE_SZ 746					//!< Space for the longest status line from formatStatusParams(), with numbers of any value
 #define CONFIG_FILE_SZ 10000
 
+#define WRITER_RING_LEN 64					//!< Number of message slots between the controller and the writer thread. Must be a power of 2.
+#define WRITER_BUF_SZ 1024					//!< Data space in each writer message slot
+
+#define CTL_REQUEST_SZ 64					//!< Maximum length of a control socket request
+#define CTL_PACKET_SZ 1024					//!< Maximum length of a control socket reply packet
+#define CTL_MAX_STREAMS 4					//!< Maximum number of concurrent streaming requests
+#define CTL_LISTEN_BACKLOG 4
+#define CTL_IO_TIMEOUT 2					//!< Seconds a control socket connection may block a receive or send
+
+#define LOG_BATCH_LEN 64					//!< Most log lines written by one writev()
+#define LOG_STAMP_LEN 20					//!< Length of the "YYYY-MM-DD HH:MM:SS " prefix of a log line
+#define LOG_SIZE_DEFAULT 100000				//!< Size in bytes at which the log file is rotated unless log-size is set
+#define LOG_SIZE_MIN 10000
+#define LOG_GENERATIONS_DEFAULT 1			//!< Old log files kept unless log-generations is set
+#define LOG_GENERATIONS_MAX 9
+
+#define WRITE_LOG 1							// Writer thread message types
+#define WRITE_LOG_NO_TIMESTAMP 2
+#define WRITE_DISTRIB 3
+#define WRITE_STATE 4
+#define WRITE_DRIFT 5
+#define WRITE_HISTORY 6
+#define WRITE_JOURNAL 7
+
+#define STATE_MAGIC 0x50505343				//!< "PPSC"
+#define STATE_VERSION 1
+#define STATE_SAVE_INTERVAL SECS_PER_MINUTE	//!< Seconds between checkpoints of the controller state
+
+#define DRIFT_MAGIC 0x50505344				//!< "PPSD"
+#define DRIFT_VERSION 1
+#define DRIFT_HOURS 24						//!< Time of day bins of the drift model
+#define DRIFT_TEMP_BINS 40					//!< Temperature bins of the drift model
+#define DRIFT_TEMP_MIN 0.0					//!< Lower edge in degrees C of the first temperature bin
+#define DRIFT_TEMP_STEP 2.5					//!< Width in degrees C of a temperature bin
+#define DRIFT_DECAY 0.98					//!< Weight kept by a bin of the drift model when a sample is added to it
+#define DRIFT_MIN_WEIGHT 3.0				//!< Sample weight at which a bin of the drift model is used
+#define THERMAL_SMOOTHING 0.05				//!< Weight of each one second reading in the smoothed CPU temperature
+#define THERMAL_DECAY 0.99					//!< Weight kept by the thermal coefficient statistics at each one minute sample
+#define THERMAL_MIN_SAMPLES 10.0			//!< Sample weight at which the thermal coefficient is used
+#define THERMAL_MIN_VAR 0.25				//!< Variance of the temperature samples in degrees C squared at which the thermal coefficient is used
+#define THERMAL_COEF_MAX 1.0				//!< Largest thermal coefficient used in ppm per degree C
+#define CPU_TEMP_FILE "/sys/class/thermal/thermal_zone0/temp"	//!< CPU temperature in millidegrees C
+
 #define NUM_PARAMS 5
 #define ERROR_DISTRIB_LEN 121
 #define JITTER_DISTRIB_LEN 181
 #define INTRPT_DISTRIB_LEN 121
+#define PHASE_DISTRIB_LEN 201				//!< Bins of each phase latency distribution. The last bin counts all larger latencies.
+#define PHASE_BIN_USEC 10					//!< Width in microseconds of each phase latency bin
+#define LATENESS_DISTRIB_LEN 100			//!< Bins of the wakeup lateness distribution. The last bin counts all larger latenesses.
+#define LATENESS_BIN_USEC 20				//!< Width in microseconds of each wakeup lateness bin
+#define LATENESS_QUANTILE 0.999				//!< Quantile of the wakeup lateness covered by the PPS window
+#define LATENESS_DECAY 0.94387				//!< Decay each minute of the wakeup lateness distribution (12 minute half life)
 
 #define HARD_LIMIT_NONE 32768
 #define HARD_LIMIT_1024 1024
@@ -113,6 +198,10 @@
 
 #define MAX_CONFIGS 32
 
+#define CONFIG_OTHER 0				// configValue states
+#define CONFIG_ENABLED 1
+#define CONFIG_DISABLED 2
+
 #define ERROR_DISTRIB 1				// Configuration file Keys
 #define ALERT_PPS_LOST 2
 #define JITTER_DISTRIB 4
@@ -137,6 +226,10 @@
 #define PPSPHASE 2097152
 #define PROCDIR 4194304
 #define SEGREGATE 8388608
+#define NANOSECOND 16777216
+#define LOG_SIZE 33554432
+#define LOG_GENERATIONS 67108864
+#define THERMAL_FEEDFORWARD 134217728
 
 
 /*
@@ -161,6 +254,25 @@ struct timeCheckParams {
 	char *nistTime_file;
 };
 
+/**
+ * State of the stability analysis of the time error in
+ * pps-stability.cpp. Part of \b G so that the analysis
+ * starts over when the controller restarts.
+ */
+struct stabilityVars {
+	double fineSum[STABILITY_FINE_LEN];				//!< Ring of the running sum of the phase in microseconds. fineSum[n] is the sum of the first n phases.
+	double blockPhase[STABILITY_COARSE_LEN];		//!< Ring of the phase at the start of each block
+	double blockSum[STABILITY_COARSE_LEN];			//!< Ring of the running sum of the phase at the start of each block
+	int64_t n;										//!< Seconds in the analysis
+	int64_t nBlocks;								//!< Blocks started
+	int64_t lastSec;								//!< The second of the last phase recorded
+	double lastPhase;								//!< The last phase recorded
+	double adevSum[STABILITY_TAUS];					//!< Sums of the squared terms of the overlapping Allan deviation at each tau
+	double mdevSum[STABILITY_TAUS];					//!< Sums of the squared terms of the modified Allan deviation at each tau
+	unsigned adevN[STABILITY_TAUS];					//!< Terms in each \b adevSum
+	unsigned mdevN[STABILITY_TAUS];					//!< Terms in each \b mdevSum
+};
+
 /*
  * Struct for program-wide global variables.
  */
@@ -170,12 +282,14 @@ struct G {
 	int cpuVersion;									//!< The principle CPU version number for Raspberry Pi processors else 0.
 
 	bool isVerbose;									//!< Enables continuous printing of PPS-Client status params when "true".
+	bool hasStatusLine;								//!< Set "true" by \b bufferStateParams() when the state params of this second are to be published.
 
-	bool configWasRead;								//!< True if pps-client.conf was read at least once.
+	bool configWasRead;								//!< True if the current config snapshot has been applied since startup or restart.
 
 	unsigned int seq_num;							//!< Advancing count of the number of PPS interrupt timings that have been received.
 
-	int ppsTimestamp;								//!< Fractional second value of the PPS timestamp from the kernel driver
+	int ppsTimestamp;								//!< Fractional second value of the PPS timestamp from the kernel driver in units of 1/\b G.usecScale microseconds.
+	int usecScale;									//!< 1 in microsecond mode or \b NSECS_PER_USEC when "nanosecond=enable" is set at startup. Scales the controller error and correction values.
 
 	bool isControlling;								//!< Set "true" by \b getAcquireState() when the control loop can begin to control the system clock frequency.
 	unsigned int activeCount;						//!< Advancing count of active (not skipped) controller cycles once \b G.isControlling is "true".
@@ -184,7 +298,7 @@ struct G {
 	bool interruptLost;								//!< Set "true" when a PPS interrupt time fails to be received.
 	int interruptLossCount;							//!< Records the number of consecutive lost PPS interrupt times.
 
-	struct timeval t;								//!< Time of system response to the PPS interrupt received from the Linux PPS device driver.
+	struct timespec t;								//!< Time of system response to the PPS interrupt received from the Linux PPS device driver.
 
 	int tm[6];										//!< Returns the timestamp from the Linux PPS device driver as a pair of ints.
 
@@ -198,9 +312,10 @@ struct G {
 	double noiseLevel;								//!< PPS time delay value beyond which a delay is defined to be a delay spike.
 	int ppsPhase;									//!< Accounts for a possible hardware inversion of the PPS signal.
 
-	int rawError;									//!< Signed difference: \b G.ppsTimestamp - \b G.zeroOffset in \b makeTimeCorrection().
+	int rawError;									//!< Signed difference: \b G.ppsTimestamp - \b G.zeroOffset in \b makeTimeCorrection() in units of 1/\b G.usecScale microseconds.
 
 	double rawErrorDistrib[ERROR_DISTRIB_LEN];		//!< The distribution of rawError values accumulated in \b buildRawErrorDistrib().
+	double rawErrorWeight;							//!< Weight of a new sample in \b G.rawErrorDistrib[]. Entry i of the distribution is \b G.rawErrorDistrib[i] / \b G.rawErrorWeight.
 	unsigned int ppsCount;							//!< Advancing count of \b G.rawErrorDistrib[] entries made by \b buildRawErrorDistrib().
 
 	int nDelaySpikes;								//!< Current count of continuous delay spikes made by \b detectDelaySpike().
@@ -208,23 +323,27 @@ struct G {
 	int minSustainedDelay;							//!< The observed minimum delay value of a sustained sequence of delay spikes
 	bool clockChanged;								//!< Set true if an external clock change is detected.
 
-	double slewAccum;								//!< Accumulates \b G.rawError in \b getTimeSlew() and is used to determine \b G.avgSlew.
-	int slewAccum_cnt;								//!< Count of the number of times \b G.rawError has been summed into \b G.slewAccum.
-	double avgSlew;									//!< Average slew value determined by \b getTimeSlew() from the average of \b G.slewAccum each time \b G.slewAccum_cnt reaches \b SLEW_LEN.
+	int slewWindow[SLEW_LEN];						//!< The last \b SLEW_LEN \b G.rawError values in microseconds in arrival order, as a ring indexed by \b G.slewIdx.
+	int slewSorted[SLEW_LEN];						//!< The values in \b G.slewWindow in ascending order.
+	int slewIdx;									//!< Index in \b G.slewWindow of the oldest value once the window is full.
+	double slewAccum;								//!< Running sum of the values in \b G.slewWindow used to determine \b G.avgSlew.
+	int slewAccum_cnt;								//!< Count of the values in \b G.slewWindow up to \b SLEW_LEN.
+	double avgSlew;									//!< Average slew value determined by \b getTimeSlew() each second from the values in \b G.slewWindow once it is full.
 	bool slewIsLow;									//!< Set to "true" in \b getAcquireState() when \b G.avgSlew is less than \b SLEW_MAX. This is a precondition for \b getAcquireState() to set \b G.isControlling to "true".
 
-	int zeroError;									//!< The controller error resulting from removing jitter noise from \b G.rawError in \b removeNoise().
+	int zeroError;									//!< The controller error resulting from removing jitter noise from \b G.rawError in \b removeNoise() in units of 1/\b G.usecScale microseconds.
 	int hardLimit;									//!< An adaptive limit value determined by \b setHardLimit() and applied to \b G.rawError by \b clampJitter() as the final noise reduction step to generate \b G.zeroError.
 	bool clampAbsolute;								//!< Hard limit relative to zero if true else relative to average \b G.rawError.
 
 	int invProportionalGain;						//!< Controller proportional gain configured inversely to use as an int divisor.
-	int timeCorrection;								//!< Time correction value constructed in \b makeTimeCorrection().
+	int timeCorrection;								//!< Time correction value constructed in \b makeTimeCorrection() in units of 1/\b G.usecScale microseconds.
+	int correctionResidual;							//!< The part of the time corrections in nanosecond mode not yet passed to \b adjtimex() in whole microseconds.
 	struct timex t3;								//!< Passes \b G.timeCorrection to the system function \b adjtimex() in \b makeTimeCorrection().
 
 	double avgCorrection;							//!< A one-minute rolling average of \b G.timeCorrection values generated by \b getMovingAverage().
 	int correctionFifo[OFFSETFIFO_LEN];				//!< Contains the \b G.timeCorrection values from over the previous 60 seconds.
 	int correctionFifoCount;						//!< Signals that \b G.correctionFifo contains a full count of \b G.timeCorrection values.
-	int correctionAccum;							//!< Accumulates \b G.timeCorrection values from \b G.correctionFifo in \b getMovingAverage() in order to generate \b G.avgCorrection.
+	int64_t correctionAccum;						//!< Accumulates \b G.timeCorrection values from \b G.correctionFifo in \b getMovingAverage() in order to generate \b G.avgCorrection.
 
 	double integral[NUM_INTEGRALS];					//!< Array of integrals constructed by \b makeAverageIntegral().
 	double avgIntegral;								//!< One-minute average of the integrals in \b G.integral[].
@@ -234,6 +353,7 @@ struct G {
 	double integralGain;							//!< Current controller integral gain.
 	double integralTimeCorrection;					//!< Integral or average integral of \b G.timeCorrection returned by \b getIntegral();
 	double freqOffset;								//!< System clock frequency correction calculated as \b G.integralTimeCorrection * \b G.integralGain.
+	double thermalCorrection;						//!< Frequency correction in ppm added to \b G.freqOffset by the thermal feedforward since the last integral update.
 
 	bool doNISTsettime;
 	bool nistTimeUpdated;
@@ -252,8 +372,8 @@ struct G {
 	char logbuf[LOGBUF_SZ];
 	char msgbuf[MSGBUF_SZ];
 	char savebuf[MSGBUF_SZ];
+	int savebufLen;									//!< Length of the text in \b G.savebuf
 	char strbuf[STRBUF_SZ];
-	char *configVals[MAX_CONFIGS];
 
 	bool exit_requested;
 	bool exitOnLostPPS;
@@ -267,7 +387,6 @@ struct G {
 	time_t pps_t_sec;
 	int pps_t_usec;
 
-	unsigned int config_select;
 
 	int intervalCount;
 
@@ -289,6 +408,13 @@ struct G {
 	int jitterDistrib[JITTER_DISTRIB_LEN];
 	int jitterCount;
 
+	int64_t phaseStart;
+	int phaseUsec[PPS_NUM_PHASES];
+	int phaseDistrib[PPS_NUM_PHASES][PHASE_DISTRIB_LEN];
+	struct ppsPhaseLatency phaseLatency;
+
+	struct stabilityVars stab;
+
 	int errorDistrib[ERROR_DISTRIB_LEN];
 	int errorCount;
 	bool queryWait;
@@ -299,7 +425,6 @@ struct G {
 	__time_t timestampRec[NUM_5_MIN_INTERVALS];
 	int offsetRec[SECS_PER_10_MIN];
 	char serialPort[50];
-	char configBuf[CONFIG_FILE_SZ];
 	/**
 	 * @endcond
 	 */
@@ -328,8 +453,9 @@ struct saveFileData {
 	void *array;				//!< Array to hold data to be saved
 	const char *filename;		//!< Filename to save data
 	int arrayLen;				//!< Length of the array in array units
-	int arrayType;				//!< Array type: 1 - int, 2 - double
+	int arrayType;				//!< Array type: 2 - double, 3 - frequency vars, 4 - offsets, 5 - timestamp stream, 6 - phase latencies, 7 - quantiles, 8 - history
 	int arrayZero;				//!< Array index of data zero.
+	const double *weight;		//!< Sample weight of a decaying distribution or NULL
 };
 
 /**
@@ -344,9 +470,11 @@ struct ppsFiles {
 	char old_log_file[100];
 	char pidFilename[100];
 	char config_file[100];
-	char assert_file[100];
-	char displayParams_file[100];
-	char arrayData_file[100];
+	char timestamp_file[100];
+	char status_file[100];
+	char history_file[100];
+	char journal_file[100];
+	char control_socket[100];
 	char pps_device[100];
 	char module_file[100];
 	char pps_msg_file[100];
@@ -354,59 +482,187 @@ struct ppsFiles {
 	char gmtTime_file[50];
 	char nistTime_file[50];
 	char integral_state_file[50];
+	char drift_file[50];
 	char home_file[50];
 	char cpuinfo_file[50];
 };
 
-struct intPair {
-	int val;
-	int nVals;
+/**
+ * The parsed value of one config key.
+ */
+struct configValue {
+	const char *str;							//!< The value string or NULL if the key is not present.
+	int state;									//!< CONFIG_ENABLED, CONFIG_DISABLED or CONFIG_OTHER.
+	int intVal;									//!< The value as an integer if \b isInt.
+	bool isInt;									//!< "true" if the value string is an integer.
+};
+
+/**
+ * An immutable parsed copy of pps-client.conf. Snapshots
+ * are built by the config watcher thread and swapped into
+ * use by getConfigs().
+ */
+struct configSnapshot {
+	unsigned int config_select;					//!< Bit ctz(key) is set if the config key is present.
+	struct configValue vals[MAX_CONFIGS];		//!< The value of each config key indexed by ctz(key).
+	char configBuf[CONFIG_FILE_SZ];				//!< The config file text holding the value strings.
+};
+
+/**
+ * The source of the PPS timestamp and the system time
+ * and the means of adjusting the system clock used by
+ * the controller. \b clk points to the backend in use.
+ */
+struct clockBackend {
+	const char *name;							//!< Name of the backend
+	int (*adjustClock)(struct timex *);			//!< Adjusts the clock as \b adjtimex() does.
+	int (*getTime)(clockid_t, struct timespec *);	//!< Reads CLOCK_REALTIME or CLOCK_MONOTONIC as \b clock_gettime() does.
+	int (*sleepUntil)(clockid_t, const struct timespec *);	//!< Sleeps until an absolute time as \b clock_nanosleep(TIMER_ABSTIME) does.
+	int (*fetchPPS)(pps_handle_t *, int *, struct timespec *);	//!< Waits for and returns the next PPS timestamp as \b readPPSTimestamp() does.
+	int (*getTemperature)(double *);			//!< Reads the temperature in degrees C of the oscillator. Returns 0 or -1 if not available.
+	bool ownsSystemClock;						//!< "true" if the backend sets the real system clock.
+};
+
+/**
+ * A quantile sketch of values in microseconds. Bin k of
+ * \b pos or \b neg counts the values of magnitude between
+ * SKETCH_MIN_VALUE * gamma^(k-1) and SKETCH_MIN_VALUE * gamma^k,
+ * where gamma = (1 + SKETCH_ALPHA) / (1 - SKETCH_ALPHA).
+ */
+struct quantileSketch {
+	uint32_t pos[SKETCH_LEN];					//!< Counts of positive values
+	uint32_t neg[SKETCH_LEN];					//!< Counts of negative values
+	uint32_t zero;								//!< Count of values smaller in magnitude than SKETCH_MIN_VALUE
+	uint32_t count;								//!< Count of all values
+	double min;									//!< Smallest value
+	double max;									//!< Largest value
+};
+
+/**
+ * The quantile sketches of a statistic.
+ */
+struct sketchStream {
+	struct quantileSketch total;				//!< All values since the daemon started
+	struct quantileSketch interval[SKETCH_INTERVALS];	//!< The values in each of the last SKETCH_INTERVALS intervals
+	int current;								//!< Index in \b interval of the current interval
+	int intervalCount;							//!< Values in the current interval
+};
+
+/**
+ * A point of the history store covering the interval of
+ * its tier that starts at second \b t.
+ */
+struct historyPoint {
+	int64_t t;									//!< Start of the interval in seconds
+	uint32_t count;								//!< Seconds recorded in the interval
+	float offsetMean;							//!< Mean time correction in microseconds
+	float offsetMin;							//!< Smallest time correction in microseconds
+	float offsetMax;							//!< Largest time correction in microseconds
+	double freqOffset;							//!< Mean frequency offset in ppm
+};
+
+/**
+ * A tier of the history store: a ring of \b len points
+ * of \b step seconds starting at \b points[first].
+ */
+struct historyTier {
+	int32_t step;								//!< Seconds in each point
+	int32_t len;								//!< Points in the ring
+	int32_t first;								//!< Index in \b points of the ring
+	uint32_t head;								//!< Index in the ring of the next point to write
+	uint32_t filled;							//!< Points written to the ring, up to \b len
+	struct historyPoint acc;					//!< The point of the current interval being accumulated
+};
+
+/**
+ * The layout of the history file.
+ */
+struct historyFile {
+	uint32_t magic;								//!< HISTORY_MAGIC once the store is initialized
+	uint32_t version;							//!< HISTORY_VERSION
+	struct historyTier tier[HISTORY_TIERS];
+	struct historyPoint points[HISTORY_POINTS];
+};
+
+/**
+ * The checkpoint of the controller state written to
+ * the state file by saveLastState() and checkpointState()
+ * and restored by loadLastState().
+ */
+struct savedState {
+	uint32_t magic;								//!< STATE_MAGIC
+	uint32_t version;							//!< STATE_VERSION
+	uint32_t size;								//!< sizeof(struct savedState)
+	uint32_t checksum;							//!< FNV-1a checksum of the checkpoint with this field zero
+	int64_t savedAt;							//!< The PPS second of the checkpoint
+	double integral[NUM_INTEGRALS];
+	double avgIntegral;
+	double integralTimeCorrection;
+	double freqOffset;							//!< For reference. Restored from \b integralTimeCorrection.
+	int64_t correctionAccum;
+	int32_t correctionFifo[OFFSETFIFO_LEN];
+	int32_t correctionFifo_idx;
+	int32_t correctionFifoCount;
+	int32_t integralCount;
+	int32_t activeCount;
+	uint32_t seq_num;
+	int32_t hardLimit;
+	int32_t usecScale;							//!< \b G.usecScale of \b correctionFifo and \b correctionAccum
+	uint8_t slewIsLow;
+	uint8_t isControlling;
+	uint8_t reserved[2];
+};
+
+/**
+ * A bin of the drift model holding the decaying mean
+ * of the frequency offsets recorded in the bin.
+ */
+struct driftBin {
+	double weight;								//!< Decayed count of the samples in the bin
+	double mean;								//!< Frequency offset in ppm
+};
+
+/**
+ * The model of the frequency offset of the system clock
+ * against CPU temperature and time of day kept in the
+ * drift file by addDriftSample().
+ */
+struct driftModel {
+	uint32_t magic;								//!< DRIFT_MAGIC
+	uint32_t version;							//!< DRIFT_VERSION
+	uint32_t size;								//!< sizeof(struct driftModel)
+	uint32_t checksum;							//!< FNV-1a checksum of the model with this field zero
+	int64_t updatedAt;							//!< The PPS second of the last sample
+	uint32_t samples;							//!< Samples added since the model was created
+	uint32_t reserved;
+	struct driftBin all;						//!< All samples
+	struct driftBin hour[DRIFT_HOURS];			//!< Samples by UTC hour
+	struct driftBin temp[DRIFT_TEMP_BINS];		//!< Samples by CPU temperature from DRIFT_TEMP_MIN in steps of DRIFT_TEMP_STEP
+};
+
+/**
+ * A line to append to the log file.
+ */
+struct logLine {
+	const char *msg;			//!< The text of the line
+	int len;					//!< Length of msg
+	time_t t;					//!< Time to timestamp the line with
+	bool addTimestamp;			//!< If "true" prefix the timestamp
 };
 
 /**
- * Construcor for an ordered list.
+ * A file write request passed from the controller
+ * to the writer thread.
  */
-class List {
-
-private:
-	int ln;
-	int size;
-	int count;
-
-	void insert(int idx, int val){
-		for (int i = ln; i >= idx; i--){
-			lst[i+1] = lst[i];
-		}
-		lst[idx].val = val;
-		lst[idx].nVals = 1;
-		ln += 1;
-	}
-
-public:
-	struct intPair *lst;
-
-	void clear(void){
-		for (int i = 0; i < size; i++){
-			lst[i].val = 0;
-			lst[i].nVals = 0;
-		}
-		ln = 0;
-		count = 0;
-	}
-
-	List(int sz){
-		size = sz;
-		lst = new intPair[size];
-
-		clear();
-	}
-
-	~List(){
-		delete[] lst;
-	}
-
-	int binaryInsert(int val);
-	double averageBelow(int maxVal);
+struct writerMsg {
+	int type;					//!< One of the WRITE_ message types
+	time_t t;					//!< Time the message was queued
+	int len;					//!< Length of the data in buf in bytes
+	int scaleZero;				//!< Array index of distribution zero for WRITE_DISTRIB
+	bool rollover;				//!< Distribution epoch rollover for WRITE_DISTRIB
+	const char *filename;		//!< Forming distribution file for WRITE_DISTRIB
+	const char *last_filename;	//!< Completed distribution file for WRITE_DISTRIB
+	char buf[WRITER_BUF_SZ];	//!< Message text or distribution data
 };
 
 int sysCommand(const char *);
@@ -419,8 +675,10 @@ int writeFileMsgToLogbuf(const char *, char *);
 void writeToLog(char *, const char *);
 pid_t getChildPID(void);
 int createPIDfile(void);
-void writeOffsets(void);
-void writeTimestamp(double);
+int writeOffsetsTo(int);
+int writeFrequencyVarsTo(int);
+int writeDoubleArrayTo(int, const double *, int, int, const double *);
+int writePhaseLatencyTo(int);
 int bufferStateParams(void);
 int disableNTP(void);
 int enableNTP(void);
@@ -429,10 +687,20 @@ int read_logerr(int fd, char *, int, const char *);
 void writeInterruptDistribFile(void);
 int getConfigs(void);
 bool isEnabled(int);
+const char *getString(int);
+bool getInt(int, int *);
 bool isDisabled(int);
 void writeSysdelayDistribFile(void);
 void showStatusEachSecond(void);
-struct timespec setSyncDelay(int, int);
+int initSyncTimer(void);
+void freeSyncTimer(void);
+void setNextWakeTime(int);
+void sleepUntilWakeTime(void);
+int getPPSWindow(void);
+void startPhaseTiming(void);
+void markPhase(int);
+void recordPhaseLatencies(void);
+void updatePPSWindow(int);
 int accessDaemon(int argc, char *argv[]);
 void buildErrorDistrib(int);
 void buildJitterDistrib(int);
@@ -444,13 +712,79 @@ void recordOffsets(int timeCorrection);
 void writeToLogNoTimestamp(char *);
 int getTimeErrorOverSerial(int *);
 int find_source(const char *path, pps_handle_t *handle, int *avail_mode);
-int readPPSTimestamp(pps_handle_t *handle, int *avail_mode, int *tm);
+int readPPSTimestamp(pps_handle_t *handle, int *avail_mode, struct timespec *ts);
 void saveGPSTime(timeCheckParams *tcp);
 int saveLastState(void);
 int loadLastState(void);
 int getRootHome(void);
 int getRPiCPU(void);
 int assignProcessorAffinity(void);
+void writeLogToFile(const char *, time_t, bool);
+void writeLogLines(const struct logLine *, int);
+void setLogRotation(int, int);
+int replaceFile(const char *, const void *, size_t, const char *, char *);
+int writeStateFile(const struct savedState *, char *);
+void checkpointState(void);
+int queueState(const struct savedState *);
+int queueDrift(int64_t, double);
+int queueHistory(int64_t, double, double);
+int queueJournal(const struct ppsJournalRecord *);
+void writeDistributionFile(const int *, int, int, bool, const char *, const char *, char *);
+int initTimestampShm(void);
+void freeTimestampShm(void);
+void publishTimestamp(int64_t, int32_t);
+int initStatusShm(void);
+void freeStatusShm(void);
+void getStatusParams(struct ppsStatusParams *);
+void publishStatus(const char *, bool);
+int formatStatusParams(const struct ppsStatusParams *, char *);
+void couldNotOpenMsgTo(char *, const char *, const char *);
+const struct ppsTimestamp *getTimestampShm(void);
+int createNormalThread(pthread_t *, void *(*)(void *), void *, size_t);
+int startConfigWatcher(void);
+void stopConfigWatcher(void);
+int startControlThread(void);
+void stopControlThread(void);
+int startWriterThread(void);
+void stopWriterThread(void);
+int queueLogMsg(const char *, bool);
+int queueDistrib(const int *, int, int, bool, const char *, const char *);
+int initialize(bool);
+void addDecayingSample(double *, double *, int);
+void normalizeDistrib(double *, int, double *);
+void decayDistrib(double *, int, double *, double);
+void buildRawErrorDistrib(int, double *, double *, unsigned int *);
+bool detectDelaySpike(int);
+void getTimeSlew(int);
+void setHardLimit(double);
+int clampJitter(int);
+int removeNoise(int);
+void detectMissedPPS(void);
+int makeTimeCorrection(struct timespec);
+int readPPS_SetTime(bool, timeCheckParams *, pps_handle_t *, int *);
+void sketchAdd(struct quantileSketch *, double);
+void sketchMerge(struct quantileSketch *, const struct quantileSketch *);
+double sketchQuantile(const struct quantileSketch *, double);
+void addStatsSample(struct sketchStream *, double);
+int writeQuantilesTo(int, const struct sketchStream *);
+int initHistory(void);
+void freeHistory(void);
+void addHistorySample(int64_t, double, double);
+void recordHistory(int64_t, double, double);
+int writeHistoryTo(int);
+int initJournal(void);
+void freeJournal(void);
+void appendJournalRecord(const struct ppsJournalRecord *);
+void journalEvent(int, double, double);
+void recordStability(int64_t, double);
+int writeStabilityTo(int);
+int addDriftSample(int64_t, double, char *);
+int saveDriftModel(char *);
+void recordDrift(int64_t, double);
+void seedFrequency(void);
+void foldThermalCorrection(void);
+void thermalFeedforward(bool);
+void sampleTemperature(void);
 /**
  * @endcond
  */
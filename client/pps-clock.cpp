@@ -0,0 +1,143 @@
+/**
+ * @file pps-clock.cpp
+ * @brief This file contains the clock backend through which the
+ * controller reads the PPS timestamp and the system time and
+ * adjusts the system clock.
+ *
+ * The default backend uses the Linux PPS driver, clock_gettime(),
+ * adjtimex() and the CPU thermal zone. The thermal zone is read by
+ * the writer thread, because a read can be slow, and the controller
+ * gets the last reading. A test program can point
+ * \b clk at another backend to run the controller against a
+ * simulated clock.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+#include <atomic>
+#include <climits>
+
+#define TEMP_NOT_READ INT_MIN						// milliDegC before the first reading
+#define TEMP_UNAVAILABLE (INT_MIN + 1)				// milliDegC if the thermal zone can't be read
+
+extern struct ppsFiles f;
+
+/**
+ * Local file-scope shared variables.
+ */
+static struct clockLocalVars {
+	int tempFd;										// The thermal zone, held open, or -1
+	pthread_mutex_t tempLock;						// Held while the thermal zone is read
+} cl = {-1, PTHREAD_MUTEX_INITIALIZER};
+
+static std::atomic<int> milliDegC(TEMP_NOT_READ);	// Last reading of the thermal zone
+
+/**
+ * System call
+ */
+extern int adjtimex (struct timex *timex);
+
+/**
+ * Adjusts the system clock.
+ */
+static int systemAdjustClock(struct timex *t){
+	return adjtimex(t);
+}
+
+/**
+ * Reads the system clock.
+ */
+static int systemGetTime(clockid_t clockId, struct timespec *ts){
+	return clock_gettime(clockId, ts);
+}
+
+/**
+ * Sleeps until an absolute time of the system clock.
+ */
+static int systemSleepUntil(clockid_t clockId, const struct timespec *ts){
+	return clock_nanosleep(clockId, TIMER_ABSTIME, ts, NULL);
+}
+
+/**
+ * Reads the CPU temperature from the thermal zone, which
+ * is the nearest measure of the oscillator temperature,
+ * into the reading returned by systemGetTemperature().
+ * The thermal zone is opened once and held open. Called
+ * by the writer thread once a second. Does nothing unless
+ * thermal-feedforward or the drift model is in use.
+ */
+void sampleTemperature(void){
+	char buf[16];
+
+	if (! isEnabled(THERMAL_FEEDFORWARD) && f.drift_file[0] == '\0'){
+		return;
+	}
+	if (pthread_mutex_trylock(&cl.tempLock) != 0){
+		return;										// Being read by another thread
+	}
+
+	if (cl.tempFd == -1){
+		cl.tempFd = open(CPU_TEMP_FILE, O_RDONLY | O_CLOEXEC);
+	}
+	int rv = (cl.tempFd == -1) ? -1 : pread(cl.tempFd, buf, sizeof(buf) - 1, 0);
+	if (rv <= 0){
+		milliDegC.store(TEMP_UNAVAILABLE, std::memory_order_relaxed);
+	}
+	else {
+		buf[rv] = '\0';
+		milliDegC.store(atoi(buf), std::memory_order_relaxed);
+	}
+
+	pthread_mutex_unlock(&cl.tempLock);
+}
+
+/**
+ * Gets the last CPU temperature read by sampleTemperature().
+ * Only the first call, at startup before the writer thread
+ * runs, reads the thermal zone itself.
+ */
+static int systemGetTemperature(double *degC){
+	int mdeg = milliDegC.load(std::memory_order_relaxed);
+
+	if (mdeg == TEMP_NOT_READ){
+		sampleTemperature();
+		mdeg = milliDegC.load(std::memory_order_relaxed);
+	}
+	if (mdeg == TEMP_NOT_READ || mdeg == TEMP_UNAVAILABLE){
+		return -1;
+	}
+	*degC = mdeg * 1e-3;							// Millidegrees
+	return 0;
+}
+
+/**
+ * The backend that controls the system clock.
+ */
+struct clockBackend systemClock = {
+	"system",
+	&systemAdjustClock,
+	&systemGetTime,
+	&systemSleepUntil,
+	&readPPSTimestamp,
+	&systemGetTemperature,
+	true
+};
+
+struct clockBackend *clk = &systemClock;				//!< The clock backend used by the controller.
@@ -0,0 +1,394 @@
+/**
+ * @file pps-control.cpp
+ * @brief This file contains the control socket through which
+ * the PPS-Client command line requests data from the daemon.
+ *
+ * The daemon listens on a SOCK_SEQPACKET Unix domain socket,
+ * by default /run/pps-client.sock, in a thread that runs at
+ * normal priority so that requests never delay the controller.
+ *
+ * A request is a single packet containing one of the labels in
+ * arrayData[]. The daemon replies with a packet containing "OK"
+ * or "ERROR: " followed by the reason, then sends the requested
+ * data as text in one or more packets and closes the connection.
+ * A request for a streaming label is instead handed to a stream
+ * thread that sends one line for each PPS until the client
+ * closes the connection.
+ *
+ * A client can stop reading or sending at any time, so no
+ * connection may block a thread for long: a request connection
+ * times out after CTL_IO_TIMEOUT seconds in a receive or send, a
+ * stream is dropped as soon as its client falls behind and the
+ * open connections are shut down when the daemon exits.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+#include <atomic>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern struct G g;
+extern struct ppsFiles f;
+extern struct saveFileData arrayData[];
+extern int arrayDataLen;
+
+/**
+ * Local file-scope shared variables.
+ */
+static struct controlLocalVars {
+	int listenFd;
+	pthread_t tid;
+	bool isRunning;
+	std::atomic<bool> exitRequested;
+	pthread_t streamTid[CTL_MAX_STREAMS];
+	std::atomic<int> streamFd[CTL_MAX_STREAMS];		// -1 when the stream slot is free
+	std::atomic<int> requestFd;						// Connection being serviced by the control thread or -1
+	pthread_mutex_t fdLock;							// Held while an open connection is closed or shut down
+	char logbuf[LOGBUF_SZ];							// Control thread message space
+} c;
+
+/**
+ * Closes a connection and marks it closed in *slot under
+ * fdLock so that stopControlThread() never shuts down an
+ * fd that has been closed and reused.
+ */
+static void closeConnection(int fd, std::atomic<int> *slot){
+	pthread_mutex_lock(&c.fdLock);
+	slot->store(-1);
+	close(fd);
+	pthread_mutex_unlock(&c.fdLock);
+}
+
+/**
+ * Creates a thread at normal (SCHED_OTHER) priority
+ * with all signals blocked.
+ *
+ * @param[out] tid The thread id.
+ * @param[in] fn The thread function.
+ * @param[in] arg The thread argument.
+ * @param[in] stackSize The thread stack size.
+ *
+ * @returns 0 on success, else the pthread_create() error.
+ */
+int createNormalThread(pthread_t *tid, void *(*fn)(void *), void *arg, size_t stackSize){
+	pthread_attr_t attr;
+	struct sched_param param;
+	sigset_t set, oldset;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, stackSize);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);	// Don't inherit SCHED_FIFO
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	param.sched_priority = 0;
+	pthread_attr_setschedparam(&attr, &param);
+
+	sigfillset(&set);												// Leave signals to the controller thread.
+	pthread_sigmask(SIG_BLOCK, &set, &oldset);
+	int rv = pthread_create(tid, &attr, fn, arg);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	pthread_attr_destroy(&attr);
+	return rv;
+}
+
+/**
+ * Sends a one-packet reply to a request.
+ *
+ * @param[in] fd The connection.
+ * @param[in] reply The reply text.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+static int sendReply(int fd, const char *reply){
+	if (send(fd, reply, strlen(reply), MSG_NOSIGNAL) == -1){
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Sends a line for each PPS from the timestamp record
+ * until the client closes the connection or the daemon
+ * exits.
+ *
+ * @param[in] arg The stream slot index.
+ */
+static void *streamThread(void *arg){
+	long slot = (long)arg;
+	int fd = c.streamFd[slot].load();
+	struct ppsTimestamp ts;
+	struct timespec timeout = {2, 0};
+	char line[100];
+
+	const struct ppsTimestamp *shm = getTimestampShm();		// The daemon maps the record writable.
+
+	uint32_t last = 0;
+	if (shm != NULL && ppsReadTimestamp(shm, &ts) == 0){
+		last = ts.seq;
+	}
+
+	while (shm != NULL && ! c.exitRequested.load()){
+		if (ppsWaitForUpdate(&shm->seq, (uint32_t *)&shm->waiters, last, &timeout) == -1){
+			continue;
+		}
+		if (ppsReadTimestamp(shm, &ts) == -1){
+			continue;
+		}
+		last = ts.seq;
+
+		sprintf(line, "%lld.%09d %u %d %lf\n", (long long)ts.sec, ts.nsec,
+				ts.seq_num, ts.timeCorrection, ts.freqOffset);
+		if (send(fd, line, strlen(line), MSG_NOSIGNAL | MSG_DONTWAIT) == -1){
+			break;											// Client closed the connection or stopped reading.
+		}
+	}
+
+	closeConnection(fd, &c.streamFd[slot]);
+	return NULL;
+}
+
+/**
+ * Hands a streaming request to a free stream thread.
+ *
+ * @param[in] fd The connection.
+ *
+ * @returns 0 if the stream thread owns the
+ * connection, else -1.
+ */
+static int startStream(int fd){
+
+	for (long i = 0; i < CTL_MAX_STREAMS; i++){
+		if (c.streamFd[i].load() == -1){
+			if (c.streamTid[i] != 0){
+				pthread_join(c.streamTid[i], NULL);		// Reap the thread that last used the slot.
+				c.streamTid[i] = 0;
+			}
+
+			c.streamFd[i].store(fd);
+			int rv = createNormalThread(&c.streamTid[i], &streamThread, (void *)i, CTL_STACK_SZ);
+			if (rv != 0){
+				c.streamFd[i].store(-1);
+				c.streamTid[i] = 0;
+				sprintf(c.logbuf, "ERROR: Can't create stream thread: %s\n", strerror(rv));
+				sendReply(fd, c.logbuf);
+				return -1;
+			}
+			return 0;
+		}
+	}
+	sendReply(fd, "ERROR: Too many streaming requests\n");
+	return -1;
+}
+
+/**
+ * Reads a request from a connection and sends the
+ * reply and the requested data.
+ *
+ * @param[in] fd The connection.
+ *
+ * @returns 0 if the connection is closed by the
+ * caller, else 1 if it is now owned by a stream thread.
+ */
+static int handleRequest(int fd){
+	char request[CTL_REQUEST_SZ];
+
+	int n = recv(fd, request, CTL_REQUEST_SZ - 1, 0);
+	if (n <= 0){
+		return 0;
+	}
+	request[n] = '\0';
+	request[strcspn(request, " \n")] = '\0';
+
+	const struct saveFileData *d = NULL;
+	for (int i = 0; i < arrayDataLen; i++){
+		if (strcmp(request, arrayData[i].label) == 0){
+			d = &arrayData[i];
+			break;
+		}
+	}
+	if (d == NULL){
+		snprintf(c.logbuf, LOGBUF_SZ, "ERROR: Request \"%s\" not recognized\n", request);
+		sendReply(fd, c.logbuf);
+		return 0;
+	}
+
+	if (sendReply(fd, "OK\n") == -1){
+		return 0;
+	}
+
+	int rv = 0;												// The arrays are read while the controller
+	switch (d->arrayType){									// updates them, so a file may mix values
+	case 2:													// from adjacent seconds.
+		rv = writeDoubleArrayTo(fd, (double *)d->array, d->arrayLen, d->arrayZero, d->weight);
+		break;
+	case 3:
+		rv = writeFrequencyVarsTo(fd);
+		break;
+	case 4:
+		rv = writeOffsetsTo(fd);
+		break;
+	case 5:
+		if (startStream(fd) == 0){
+			return 1;
+		}
+		break;
+	case 6:
+		rv = writePhaseLatencyTo(fd);
+		break;
+	case 7:
+		rv = writeQuantilesTo(fd, (const struct sketchStream *)d->array);
+		break;
+	case 8:
+		rv = writeHistoryTo(fd);
+		break;
+	case 9:
+		rv = writeStabilityTo(fd);
+		break;
+	}
+
+	if (rv == -1 && errno != EPIPE){
+		sprintf(c.logbuf, "Control socket write failed for \"%s\": %s\n", request, strerror(errno));
+		writeToLog(c.logbuf, "handleRequest()");
+	}
+	return 0;
+}
+
+/**
+ * Accepts and services control socket connections
+ * until stopControlThread() shuts down the socket.
+ */
+static void *controlThread(void *arg){
+	struct timeval timeout = {CTL_IO_TIMEOUT, 0};
+
+	for (;;){
+		int fd = accept(c.listenFd, NULL, NULL);
+		if (fd == -1){
+			if (errno == EINTR || errno == ECONNABORTED){
+				continue;
+			}
+			break;											// Socket was shut down.
+		}
+
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		c.requestFd.store(fd);
+		if (handleRequest(fd) == 0){
+			closeConnection(fd, &c.requestFd);
+		}
+		else {
+			c.requestFd.store(-1);							// Now owned by a stream thread
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Creates the control socket in the run directory and
+ * starts the thread that services it.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int startControlThread(void){
+	struct sockaddr_un addr;
+
+	c.isRunning = false;
+	c.exitRequested.store(false);
+	c.requestFd.store(-1);
+	pthread_mutex_init(&c.fdLock, NULL);
+	for (int i = 0; i < CTL_MAX_STREAMS; i++){
+		c.streamTid[i] = 0;
+		c.streamFd[i].store(-1);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, f.control_socket, sizeof(addr.sun_path) - 1);
+
+	c.listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (c.listenFd == -1){
+		sprintf(g.logbuf, "Can't create control socket: %s\n", strerror(errno));
+		writeToLog(g.logbuf, "startControlThread()");
+		return -1;
+	}
+
+	unlink(f.control_socket);								// Remove a socket left by a previous run.
+	if (bind(c.listenFd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+			|| listen(c.listenFd, CTL_LISTEN_BACKLOG) == -1){
+		sprintf(g.logbuf, "Can't bind control socket %s: %s\n", f.control_socket, strerror(errno));
+		writeToLog(g.logbuf, "startControlThread()");
+		close(c.listenFd);
+		c.listenFd = -1;
+		return -1;
+	}
+
+	int rv = createNormalThread(&c.tid, &controlThread, NULL, CTL_STACK_SZ);
+	if (rv != 0){
+		sprintf(g.logbuf, "Can't create control thread : %s\n", strerror(rv));
+		writeToLog(g.logbuf, "startControlThread()");
+		close(c.listenFd);
+		c.listenFd = -1;
+		unlink(f.control_socket);
+		return -1;
+	}
+
+	c.isRunning = true;
+	return 0;
+}
+
+/**
+ * Stops the control thread and any stream threads
+ * and removes the control socket.
+ */
+void stopControlThread(void){
+	if (! c.isRunning){
+		return;
+	}
+	c.isRunning = false;
+	c.exitRequested.store(true);
+
+	shutdown(c.listenFd, SHUT_RDWR);						// Causes accept() to fail.
+
+	pthread_mutex_lock(&c.fdLock);							// Wakes threads blocked on open connections.
+	int fd = c.requestFd.load();
+	if (fd != -1){
+		shutdown(fd, SHUT_RDWR);
+	}
+	for (int i = 0; i < CTL_MAX_STREAMS; i++){
+		fd = c.streamFd[i].load();
+		if (fd != -1){
+			shutdown(fd, SHUT_RDWR);
+		}
+	}
+	pthread_mutex_unlock(&c.fdLock);
+
+	pthread_join(c.tid, NULL);
+	close(c.listenFd);
+	c.listenFd = -1;
+	unlink(f.control_socket);
+
+	for (int i = 0; i < CTL_MAX_STREAMS; i++){				// Stream threads exit within
+		if (c.streamTid[i] != 0){							// one wait timeout.
+			pthread_join(c.streamTid[i], NULL);
+			c.streamTid[i] = 0;
+		}
+	}
+}
@@ -0,0 +1,319 @@
+/**
+ * @file pps-drift.cpp
+ * @brief This file contains the drift model that predicts the
+ * frequency offset of the system clock at startup.
+ *
+ * The frequency offset of the oscillator of the system clock
+ * depends mostly on its temperature, which follows the CPU
+ * temperature and, through the room temperature, the time of day.
+ * Each five minute average of the frequency offset recorded by
+ * recordFrequencyVars() while the controller is settled is added,
+ * along with the CPU temperature at the time, to a model of decaying
+ * means of the frequency offset in bins of temperature and of UTC
+ * hour. The samples are added by the writer thread, which also reads
+ * the temperature and rewrites the model in the drift file in the
+ * home directory of root, so the model persists across restarts of
+ * the daemon and of the system. The controller thread never writes
+ * the file: while the writer thread is not running the samples are
+ * added to the model in memory and saveDriftModel() writes it when
+ * the daemon exits.
+ *
+ * When the controller starts or restarts, seedFrequency() predicts
+ * the frequency offset at the present CPU temperature, or at the
+ * present hour if the temperature is not available or has not been
+ * seen, and sets it as the starting point of the integrators and
+ * of the system clock frequency so that the controller does not
+ * have to find it from zero. A state restored by loadLastState()
+ * takes the place of the prediction.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+
+extern struct G g;
+extern struct ppsFiles f;
+extern struct clockBackend *clk;
+
+/**
+ * Local file-scope shared variables.
+ */
+static struct driftLocalVars {
+	struct driftModel m;
+	bool isLoaded;
+	bool isDirty;								// "true" if the model has samples not yet in the drift file
+	pthread_mutex_t lock;						// Held while the model is read or updated
+} dm = {{0}, false, false, PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * Computes the FNV-1a checksum of a drift model with
+ * its \b checksum field taken as zero.
+ */
+static uint32_t driftChecksum(const struct driftModel *m){
+	struct driftModel tmp = *m;
+	const uint8_t *p = (const uint8_t *)&tmp;
+	uint32_t h = 2166136261u;
+
+	tmp.checksum = 0;
+	for (size_t i = 0; i < sizeof(struct driftModel); i++){
+		h = (h ^ p[i]) * 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Reads the drift model from the drift file the first
+ * time it is needed. A missing or invalid file starts
+ * an empty model. Called with dm.lock held.
+ */
+static void loadDriftModel(void){
+	struct driftModel *m = &dm.m;
+
+	if (dm.isLoaded){
+		return;
+	}
+	dm.isLoaded = true;
+
+	int fd = open(f.drift_file, O_RDONLY);
+	if (fd != -1){
+		int rv = read(fd, m, sizeof(struct driftModel));
+		close(fd);
+
+		if (rv == sizeof(struct driftModel) && m->magic == DRIFT_MAGIC && m->version == DRIFT_VERSION
+				&& m->size == sizeof(struct driftModel) && m->checksum == driftChecksum(m)){
+			return;
+		}
+	}
+
+	memset(m, 0, sizeof(struct driftModel));
+	m->magic = DRIFT_MAGIC;
+	m->version = DRIFT_VERSION;
+	m->size = sizeof(struct driftModel);
+}
+
+/**
+ * Adds a sample to the decaying mean of a bin.
+ */
+static void addToBin(struct driftBin *b, double freqOffset){
+	b->weight = b->weight * DRIFT_DECAY + 1.0;
+	b->mean += (freqOffset - b->mean) / b->weight;
+}
+
+/**
+ * Returns the UTC hour of time t.
+ */
+static int hourOf(int64_t t){
+	return (int)(((t % SECS_PER_DAY) + SECS_PER_DAY) % SECS_PER_DAY / SECS_PER_HOUR);
+}
+
+/**
+ * Predicts the frequency offset at a temperature by
+ * interpolating between the means of the two nearest
+ * bins or, if only one of them has enough samples,
+ * from that bin.
+ *
+ * @returns 0 on success, else -1 if neither bin
+ * has enough samples.
+ */
+static int predictFromTemp(const struct driftModel *m, double temp, double *freqOffset){
+	double x = (temp - DRIFT_TEMP_MIN) / DRIFT_TEMP_STEP - 0.5;	// Position relative to the bin centers
+	int i = (int)floor(x);
+	double frac = x - i;
+
+	bool hasLo = (i >= 0 && i < DRIFT_TEMP_BINS && m->temp[i].weight >= DRIFT_MIN_WEIGHT);
+	bool hasHi = (i + 1 >= 0 && i + 1 < DRIFT_TEMP_BINS && m->temp[i + 1].weight >= DRIFT_MIN_WEIGHT);
+
+	if (hasLo && hasHi){
+		*freqOffset = (1.0 - frac) * m->temp[i].mean + frac * m->temp[i + 1].mean;
+	}
+	else if (hasLo){
+		*freqOffset = m->temp[i].mean;
+	}
+	else if (hasHi){
+		*freqOffset = m->temp[i + 1].mean;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Adds a five minute average of the clock frequency offset
+ * to the drift model in memory at the present CPU temperature.
+ * Called with dm.lock held.
+ */
+static void addToModel(int64_t t, double freqOffset){
+	double temp;
+
+	loadDriftModel();
+	struct driftModel *m = &dm.m;
+
+	addToBin(&m->all, freqOffset);
+	addToBin(&m->hour[hourOf(t)], freqOffset);
+
+	if (clk->getTemperature(&temp) == 0){
+		int i = (int)floor((temp - DRIFT_TEMP_MIN) / DRIFT_TEMP_STEP);
+		if (i >= 0 && i < DRIFT_TEMP_BINS){
+			addToBin(&m->temp[i], freqOffset);
+		}
+	}
+
+	m->updatedAt = t;
+	m->samples += 1;
+	m->checksum = driftChecksum(m);
+}
+
+/**
+ * Adds a five minute average of the clock frequency offset
+ * to the drift model and rewrites the drift file. Called
+ * by the writer thread.
+ *
+ * @param[in] t The PPS second of the sample.
+ * @param[in] freqOffset The frequency offset in ppm.
+ * @param[out] logbuf Space for error messages.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int addDriftSample(int64_t t, double freqOffset, char *logbuf){
+	struct driftModel copy;
+
+	pthread_mutex_lock(&dm.lock);
+	addToModel(t, freqOffset);
+	copy = dm.m;
+	dm.isDirty = false;
+	pthread_mutex_unlock(&dm.lock);
+
+	return replaceFile(f.drift_file, &copy, sizeof(struct driftModel), "addDriftSample()", logbuf);
+}
+
+/**
+ * Writes the drift model to the drift file if it has
+ * samples that were added while the writer thread was
+ * not running. Called when the daemon exits and by the
+ * simulators.
+ *
+ * @param[out] logbuf Space for error messages.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int saveDriftModel(char *logbuf){
+	struct driftModel copy;
+
+	pthread_mutex_lock(&dm.lock);
+	bool isDirty = dm.isDirty;
+	copy = dm.m;
+	dm.isDirty = false;
+	pthread_mutex_unlock(&dm.lock);
+
+	if (! isDirty || f.drift_file[0] == '\0'){
+		return 0;
+	}
+	return replaceFile(f.drift_file, &copy, sizeof(struct driftModel), "saveDriftModel()", logbuf);
+}
+
+/**
+ * Passes a five minute average of the clock frequency
+ * offset to the writer thread to be added to the drift
+ * model. The sample is dropped if the writer queue is
+ * full. If the writer thread is not running the sample
+ * is added to the model in memory only, to be written
+ * by saveDriftModel(), so that the drift file is never
+ * written from the controller thread. Called by
+ * recordFrequencyVars().
+ *
+ * @param[in] t The PPS second of the sample.
+ * @param[in] freqOffset The frequency offset in ppm.
+ */
+void recordDrift(int64_t t, double freqOffset){
+	if (f.drift_file[0] == '\0'){
+		return;
+	}
+	if (queueDrift(t, freqOffset) == -1){
+		pthread_mutex_lock(&dm.lock);
+		addToModel(t, freqOffset);
+		dm.isDirty = true;
+		pthread_mutex_unlock(&dm.lock);
+	}
+}
+
+/**
+ * Starts the integrators and the system clock frequency
+ * from the frequency offset predicted by the drift model,
+ * first from the CPU temperature, then from the time of
+ * day and then from all samples. Called by initialize()
+ * after the frequency offset has been set to zero. Does
+ * nothing if the model has too few samples.
+ */
+void seedFrequency(void){
+	struct timespec ts;
+	double temp, freqOffset;
+	const char *source;
+
+	if (f.drift_file[0] == '\0'){
+		return;
+	}
+
+	clk->getTime(CLOCK_REALTIME, &ts);
+	bool hasTemp = (clk->getTemperature(&temp) == 0);
+
+	pthread_mutex_lock(&dm.lock);
+
+	loadDriftModel();
+	const struct driftModel *m = &dm.m;
+	const struct driftBin *hour = &m->hour[hourOf(ts.tv_sec)];
+
+	int rv = 0;
+	if (hasTemp && predictFromTemp(m, temp, &freqOffset) == 0){
+		source = "temperature";
+	}
+	else if (hour->weight >= DRIFT_MIN_WEIGHT){
+		freqOffset = hour->mean;
+		source = "time of day";
+	}
+	else if (m->all.weight >= DRIFT_MIN_WEIGHT){
+		freqOffset = m->all.mean;
+		source = "all samples";
+	}
+	else {
+		rv = -1;
+	}
+
+	pthread_mutex_unlock(&dm.lock);
+
+	if (rv == -1){
+		return;
+	}
+
+	double integral = freqOffset / g.integralGain;
+	for (int i = 0; i < NUM_INTEGRALS; i++){
+		g.integral[i] = integral;
+	}
+	g.integralTimeCorrection = integral;
+	g.freqOffset = freqOffset;
+	g.lastFreqOffset = freqOffset;
+
+	g.t3.modes = ADJ_FREQUENCY;
+	g.t3.freq = (long)round(ADJTIMEX_SCALE * g.freqOffset);
+	clk->adjustClock(&g.t3);
+
+	sprintf(g.logbuf, "Starting from frequency offset %.3lf ppm predicted from the drift model by %s\n",
+			freqOffset, source);
+	writeToLog(g.logbuf, "seedFrequency()");
+}
@@ -21,8 +21,14 @@
  */
 
 #include "../client/pps-client.h"
+#include <atomic>
+#include <libgen.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 
 extern struct G g;
+extern struct clockBackend *clk;
 
 const char *config_file = "/XXXX/pps-client.conf";								//!< The PPS-Client configuration file.
 const char *last_distrib_file = "/pps-error-distrib";							//!< Stores the completed distribution of offset corrections.
@@ -32,31 +38,68 @@ const char *jitter_distrib_file = "/pps-jitter-distrib-forming";				//!< Stores
 const char *log_file = "/pps-client.log";										//!< Stores activity and errors.
 const char *old_log_file = "/pps-client.old.log";								//!< Stores activity and errors.
 const char *pidFilename = "/pps-client.pid";									//!< Stores the PID of PPS-Client.
-const char *assert_file = "/pps-assert";										//!< The timestamps of the time corrections each second
-const char *displayParams_file = "/pps-display-params";							//!< Temporary file storing params for the status display
-const char *arrayData_file = "/pps-save-data";									//!< Stores a request sent to the PPS-Client daemon.
+const char *timestamp_file = "/pps-timestamp";									//!< The shared memory timestamp record of each PPS
+const char *status_file = "/pps-status";										//!< The shared memory status block for the status display
+const char *history_file = "/pps-history";										//!< The round-robin history of time corrections and frequency offsets
+const char *journal_file = "/pps-journal";										//!< The binary journal of controller events
+const char *control_socket = "/pps-client.sock";								//!< Receives requests sent to the PPS-Client daemon.
 const char *pps_msg_file = "/pps-msg";
 const char *linuxVersion_file = "/linuxVersion";
 const char *gmtTime_file = "/gmtTime";
 const char *nistTime_file = "/nist_out";
 const char *integral_state_file = "/.pps-last-state";
+const char *drift_file = "/.pps-drift-model";									//!< The model of the clock frequency offset against temperature and time of day
 const char *home_file = "/Home";
 const char *cpuinfo_file = "/cpuinfo";
 
-const char *space = " ";
-const char *num = "0123456789.";
-
 extern const char *version;
 
-static struct stat configFileStat;
-static time_t modifyTime = 0;
 static int lastJitterFileno = 0;
 static int lastErrorFileno = 0;
 static struct timespec offset_assert = {0, 0};
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The log file, kept open by writeLogLines().
+ * Protected by logLock.
+ */
+static struct logLocalVars {
+	int fd;												// The open log file or -1
+	char path[100];										// The name fd was opened with
+	ino_t ino;											// The inode fd was opened on
+	off_t size;											// The size of the log file
+	time_t checkSec;									// The second path was last checked against ino
+	int maxSize;										// The size at which the log file is rotated
+	int generations;									// The number of old log files kept
+	time_t stampSec;									// The second of stamp
+	char stamp[LOG_STAMP_LEN + 1];						// The timestamp prefix of log lines in stampSec
+} lg = {-1, {0}, 0, 0, 0, LOG_SIZE_DEFAULT, LOG_GENERATIONS_DEFAULT, -1, {0}};
 
 bool writeJitterDistrib = false;
 bool writeErrorDistrib = false;
 
+#define CONFIG_DIRTY 4									// Set in cf.middle when it holds a new snapshot
+
+/**
+ * Config snapshots are triple buffered: the watcher thread
+ * parses into cf.back, then exchanges it with cf.middle and
+ * marks it CONFIG_DIRTY. getConfigs() exchanges cf.front with
+ * cf.middle when it sees CONFIG_DIRTY. Neither side ever waits
+ * on the other or sees a partly written snapshot.
+ */
+static struct configLocalVars {
+	struct configSnapshot snap[3];
+	int front;											// Snapshot in use by the controller
+	int back;											// Snapshot being written by the watcher
+	std::atomic<int> middle;							// Snapshot being passed between them
+	const struct configSnapshot *active;				// &snap[front] once a config has been read
+	int inotifyFd;
+	int stopFd;											// eventfd that stops the watcher thread
+	pthread_t tid;
+	bool isRunning;
+	char logbuf[LOGBUF_SZ];								// Watcher thread message space
+} cf = {{}, 0, 1, {2}, NULL, -1, -1, 0, false, {0}};
+
 /**
  * PPS-Client internal files.
  */
@@ -95,98 +138,13 @@ const char *valid_config[] = {
 		"ppsdevice",
 		"ppsphase",
 		"procdir",
-		"segregate"
+		"segregate",
+		"nanosecond",
+		"log-size",
+		"log-generations",
+		"thermal-feedforward"
 };
 
-/**
- * List operator that inserts integer values
- * into an ordered list.
- *
- * @param[in] val The integer value to be
- * inserted into the list.
- *
- * @returns The insertion index
- */
-int List::binaryInsert(int val){
-	if (count == size){
-		return size;
-	}
-
-	count += 1;
-
-    int high = ln - 1;
-    if (ln == 0 || val > lst[high].val){
-    	insert(ln, val);
-    	return ln;
-    }
-    if (ln == 1){
-    	if (val < lst[0].val){
-    		insert(0, val);
-    		return 0;
-    	}
-        if (val > lst[0].val){
-            insert(ln, val);
-            return ln;
-        }
-        lst[0].nVals += 1;
-		return 0;
-    }
-    int low = -1;
-    int j = 0;
-    while ((high - low) > 1){
-    	j = (high + low) / 2;
-    	if (val <= lst[j].val){
-    		high = j;
-    	}
-    	else {
-    		low = j;
-    	}
-    }
-    if (lst[high].val == val){
-    	lst[high].nVals += 1;
-    	return high;
-    }
-    insert(high, val);
-    return high;
-}
-
-
-/**
- * Returns the average of all values in lst
- * that are less than maxVal. If there
- * are none the returns the lowest value
- * in lst.
- *
- * @param[in] maxVal The comparison value.
- *
- * @returns The average below maxVal
- */
-double List::averageBelow(int maxVal){
-
-	int sum = 0;
-	int n = 0;
-	double average;
-
-	if (ln == 0){
-		return 0;
-	}
-
-	for (int i = 0; i < ln; i++){
-		sum += lst[i].nVals * lst[i].val;
-		n += lst[i].nVals;
-
-		if (i < ln-1){
-			if (lst[i+1].val - lst[i].val >= maxVal){
-				break;
-			}
-		}
-	}
-
-	average = (double)sum / (double)n;
-
-	return average;
-}
-
 /**
  * system() function with error handling.
  */
@@ -204,60 +162,42 @@ int sysCommand(const char *cmd){
  * Retrieves the string from the config file assigned
  * to the valid_config string with value key.
  *
+ * The config key is a bit position in config_select that
+ * is set if the corresponding config string is found in the
+ * config file when it is read. The value of the key is then
+ * in vals[ctz(key)] of the config snapshot.
+ *
  * @param[in] key The config key corresponding to a string in
  * the valid_config[] array above.
  *
- * @returns The string assigned to the key.
+ * @returns The string assigned to the key or NULL.
  */
-char *getString(int key){
-	char *str;
-	int len;
-	int i = round(log2(key));
+const char *getString(int key){
+	const struct configSnapshot *cs = cf.active;
 
-	if (g.config_select & key){
-
-		str = g.configVals[i];
-
-		len = strlen(str);
-
-		while (str[len-1] == ' '){
-			str[len-1] = '\0';
-			len -= 1;
-		}
-
-		return str;
+	if (cs != NULL && (cs->config_select & key)){
+		return cs->vals[__builtin_ctz(key)].str;
 	}
 	return NULL;
 }
 
 /**
- * Tests configuration strings from pps-client.conf
- * for the specified string. To avoid searching the config
- * file more than once, the config key is a bit position in
- * G.config_select that is set or not set if the corresponding
- * config string is found in the config file when it is first
- * read. In that case an array G.configVals[], constructed when
- * the config file was read, will contain the string from the
- * config file that followed the valid_config. That string
- * will be G.configVals[log2(key)].
+ * Retrieves the integer value assigned to the
+ * valid_config string with value key.
  *
  * @param[in] key The config key corresponding to a string in
  * the valid_config[] array above.
+ * @param[out] val The integer value.
  *
- * @param[in] string The string that must be matched by the string
- * that follows the config string name from the valid_config[] array.
- *
- * @returns "true" if the string in the config file matches arg
- * "string", else "false".
+ * @returns "true" if the key is present and its value
+ * is an integer, else "false".
  */
-bool hasString(int key, const char *string){
-	int i = round(log2(key));
+bool getInt(int key, int *val){
+	const struct configSnapshot *cs = cf.active;
 
-	if (g.config_select & key){
-		char *val = strstr(g.configVals[i], string);
-		if (val != NULL){
-			return true;
-		}
+	if (cs != NULL && (cs->config_select & key) && cs->vals[__builtin_ctz(key)].isInt){
+		*val = cs->vals[__builtin_ctz(key)].intVal;
+		return true;
 	}
 	return false;
 }
@@ -273,7 +213,10 @@ bool hasString(int key, const char *string){
  * else "false".
  */
 bool isEnabled(int key){
-	return hasString(key, "enable");
+	const struct configSnapshot *cs = cf.active;
+
+	return cs != NULL && (cs->config_select & key)
+			&& cs->vals[__builtin_ctz(key)].state == CONFIG_ENABLED;
 }
 
 /**
@@ -287,18 +230,31 @@ bool isEnabled(int key){
  * else false.
  */
 bool isDisabled(int key){
-	return hasString(key, "disable");
+	const struct configSnapshot *cs = cf.active;
+
+	return cs != NULL && (cs->config_select & key)
+			&& cs->vals[__builtin_ctz(key)].state == CONFIG_DISABLED;
 }
 
+extern struct sketchStream jitterSketch;
+extern struct sketchStream correctionSketch;
+
 /**
  * Data associations for PPS-Client command line save
  * data requests with the -s flag.
  */
 struct saveFileData arrayData[] = {
-	{"rawError", g.rawErrorDistrib, "/var/local/pps-raw-error-distrib", ERROR_DISTRIB_LEN, 2, RAW_ERROR_ZERO},
-	{"frequency-vars", NULL, "/var/local/pps-frequency-vars", 0, 3, 0},
-	{"pps-offsets", NULL, "/var/local/pps-offsets", 0, 4, 0}
+	{"rawError", g.rawErrorDistrib, "/var/local/pps-raw-error-distrib", ERROR_DISTRIB_LEN, 2, RAW_ERROR_ZERO, &g.rawErrorWeight},
+	{"frequency-vars", NULL, "/var/local/pps-frequency-vars", 0, 3, 0, NULL},
+	{"pps-offsets", NULL, "/var/local/pps-offsets", 0, 4, 0, NULL},
+	{"pps-timestamps", NULL, NULL, 0, 5, 0, NULL},
+	{"phase-latency", NULL, "/var/local/pps-phase-latency", 0, 6, 0, NULL},
+	{"jitter-quantiles", &jitterSketch, NULL, 0, 7, 0, NULL},
+	{"correction-quantiles", &correctionSketch, NULL, 0, 7, 0, NULL},
+	{"pps-history", NULL, "/var/local/pps-history.txt", 0, 8, 0, NULL},
+	{"stability", NULL, "/var/local/pps-stability.txt", 0, 9, 0, NULL}
 };
+int arrayDataLen = sizeof(arrayData) / sizeof(struct saveFileData);
 
 /**
  * Constructs an error message.
@@ -325,79 +281,206 @@ void errorReadingMsgTo(char *logbuf, const char *filename){
 }
 
 /**
- * Appends logbuf to the log file.
+ * Opens the log file for appending unless it is already
+ * open, and reopens it if it was renamed or removed by
+ * something else. That is checked at most once a second.
+ * Called with logLock held.
  *
- * @param[in,out] logbuf Pointer to the log buffer.
+ * @returns 0 on success, else -1 on error.
  */
-void writeToLogNoTimestamp(char *logbuf){
+static int openLogFile(void){
 	struct stat info;
+	time_t now = time(NULL);
 
-	bufferStatusMsg(logbuf);
+	if (lg.fd != -1 && strcmp(lg.path, f.log_file) == 0){
+		if (now == lg.checkSec){
+			return 0;
+		}
+		lg.checkSec = now;
+		if (stat(f.log_file, &info) == 0 && info.st_ino == lg.ino){
+			return 0;
+		}
+	}
 
-	stat(f.log_file, &info);
-	if (info.st_size > 100000){			// Prevent unbounded log file growth
-		remove(f.old_log_file);
-		rename(f.log_file, f.old_log_file);
+	if (lg.fd != -1){
+		close(lg.fd);
+		lg.fd = -1;
 	}
 
 	mode_t mode = S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH;
-	int fd = open(f.log_file, O_CREAT | O_WRONLY | O_APPEND, mode);
+	int fd = open(f.log_file, O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, mode);
 	if (fd == -1){
-		couldNotOpenMsgTo(logbuf, f.log_file, "writeToLogNoTimestamp()");
-		printf("%s", logbuf);
-		return;
+		printf("ERROR: could not open \"%s\": %s writeLogToFile()\n", f.log_file, strerror(errno));
+		return -1;
+	}
+	if (fstat(fd, &info) == -1){
+		close(fd);
+		return -1;
 	}
 
-	int rv = write(fd, logbuf, strlen(logbuf));
-	if (rv == -1){
-		;
+	lg.fd = fd;
+	lg.ino = info.st_ino;
+	lg.size = info.st_size;
+	lg.checkSec = now;
+	strcpy(lg.path, f.log_file);
+	return 0;
+}
+
+/**
+ * Moves each old log file to the next generation, dropping
+ * the oldest, and the log file to the first old log file.
+ * Called with logLock held.
+ */
+static void rotateLogFile(void){
+	char from[120], to[120];
+
+	if (lg.fd != -1){
+		close(lg.fd);
+		lg.fd = -1;
 	}
-	close(fd);
+
+	for (int k = lg.generations; k > 1; k--){
+		if (k == 2){
+			strcpy(from, f.old_log_file);
+		}
+		else {
+			sprintf(from, "%s.%d", f.old_log_file, k - 1);
+		}
+		sprintf(to, "%s.%d", f.old_log_file, k);
+		rename(from, to);
+	}
+	rename(f.log_file, f.old_log_file);
 }
 
+/**
+ * Copies the timestamp prefix of a log line for time t
+ * to stamp, which must hold LOG_STAMP_LEN characters.
+ * The prefix is formatted only when the second changes.
+ * Called with logLock held.
+ */
+static void getLogStamp(time_t t, char *stamp){
+	if (t != lg.stampSec){
+		struct tm tmp;
+		localtime_r(&t, &tmp);
+		strftime(lg.stamp, LOG_STAMP_LEN + 1, "%F %H:%M:%S ", &tmp);
+		lg.stampSec = t;
+	}
+	memcpy(stamp, lg.stamp, LOG_STAMP_LEN);
+}
 
 /**
- * Appends logbuf to the log file with a timestamp.
+ * Sets the size at which the log file is rotated and the
+ * number of old log files kept.
+ *
+ * @param[in] maxSize The size in bytes.
+ * @param[in] generations The number of old log files.
+ */
+void setLogRotation(int maxSize, int generations){
+	pthread_mutex_lock(&logLock);
+	lg.maxSize = maxSize;
+	lg.generations = generations;
+	pthread_mutex_unlock(&logLock);
+}
+
+/**
+ * Appends lines to the log file, each with an optional
+ * timestamp, in one writev() for each LOG_BATCH_LEN lines,
+ * rotating the log file when it reaches the size set by
+ * setLogRotation(). The log file is kept open between calls.
+ * This function blocks on the file system and is called by
+ * the writer thread or directly when no writer thread is
+ * running.
+ *
+ * @param[in] lines The lines.
+ * @param[in] n The number of lines.
+ */
+void writeLogLines(const struct logLine *lines, int n){
+	struct iovec iov[2 * LOG_BATCH_LEN];
+	char stamps[LOG_BATCH_LEN][LOG_STAMP_LEN];
+
+	pthread_mutex_lock(&logLock);
+
+	for (int first = 0; first < n; first += LOG_BATCH_LEN){
+		int count = (n - first < LOG_BATCH_LEN) ? n - first : LOG_BATCH_LEN;
+
+		if (lg.fd != -1 && lg.size >= lg.maxSize){		// Prevent unbounded log file growth
+			rotateLogFile();
+		}
+		if (openLogFile() == -1){
+			break;
+		}
+
+		int nv = 0;
+		for (int i = 0; i < count; i++){
+			const struct logLine *l = &lines[first + i];
+			if (l->addTimestamp){
+				getLogStamp(l->t, stamps[i]);
+				iov[nv].iov_base = stamps[i];
+				iov[nv].iov_len = LOG_STAMP_LEN;
+				nv += 1;
+			}
+			iov[nv].iov_base = (void *)l->msg;
+			iov[nv].iov_len = l->len;
+			nv += 1;
+		}
+
+		ssize_t rv = writev(lg.fd, iov, nv);
+		if (rv > 0){
+			lg.size += rv;
+		}
+	}
+
+	pthread_mutex_unlock(&logLock);
+}
+
+/**
+ * Appends msg to the log file with an optional timestamp.
+ * See writeLogLines().
+ *
+ * @param[in] msg The message.
+ * @param[in] t The time to timestamp the message with.
+ * @param[in] addTimestamp If "true" prefix the timestamp.
+ */
+void writeLogToFile(const char *msg, time_t t, bool addTimestamp){
+	struct logLine l = {msg, (int)strlen(msg), t, addTimestamp};
+
+	writeLogLines(&l, 1);
+}
+
+/**
+ * Appends logbuf to the log file.
  *
  * @param[in,out] logbuf Pointer to the log buffer.
  */
-void writeToLog(char *logbuf, const char *location){
-	struct stat info;
+void writeToLogNoTimestamp(char *logbuf){
 
 	bufferStatusMsg(logbuf);
 
-	stat(f.log_file, &info);
-	if (info.st_size > 100000){			// Prevent unbounded log file growth
-		remove(f.old_log_file);
-		rename(f.log_file, f.old_log_file);
+	if (queueLogMsg(logbuf, false) != -1){		// Written by the writer thread or dropped
+		return;								// if the writer thread is stalled.
 	}
+	writeLogToFile(logbuf, time(NULL), false);
+}
 
-	mode_t mode = S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH;
-	int fd = open(f.log_file, O_CREAT | O_WRONLY | O_APPEND, mode);
-	if (fd == -1){
-		couldNotOpenMsgTo(logbuf, f.log_file, location);
-		printf("%s", logbuf);
-		return;
-	}
 
-	time_t t = time(NULL);
-	struct tm *tmp = localtime(&t);
-	strftime(g.strbuf, STRBUF_SZ-1, "%F %H:%M:%S ", tmp);
-	int rv = write(fd, g.strbuf, strlen(g.strbuf));
-	if (rv == -1){
-		;
-	}
+/**
+ * Appends logbuf to the log file with a timestamp.
+ *
+ * @param[in,out] logbuf Pointer to the log buffer.
+ */
+void writeToLog(char *logbuf, const char *location){
 
-	rv = write(fd, logbuf, strlen(logbuf));
-	if (rv == -1){
-		;
+	bufferStatusMsg(logbuf);
+
+	if (queueLogMsg(logbuf, true) != -1){		// Written by the writer thread or dropped
+		return;								// if the writer thread is stalled.
 	}
-	close(fd);
+	writeLogToFile(logbuf, time(NULL), true);
 }
 
 /**
  * Concatenates msg to a message buffer, savebuf, which is
- * saved to a tmpfs memory file by writeStatusStrings() each
+ * published to the status block by writeStatusStrings() each
  * second. These messages can be read and displayed to the
  * command line by showStatusEachSecond().
  *
@@ -410,46 +493,34 @@ void bufferStatusMsg(const char *msg){
 		fprintf(stdout, "%s", msg);
 	}
 
-	int msglen = strlen(g.savebuf) + 10;
-	int parmslen = strlen(msg);
+	int msglen = strlen(msg);
 
-	if (msglen + parmslen > MSGBUF_SZ){
+	if (g.savebufLen + msglen + 10 > MSGBUF_SZ){
 		return;
 	}
 
-	strcat(g.savebuf, msg);
-
-	return;
+	memcpy(g.savebuf + g.savebufLen, msg, msglen + 1);
+	g.savebufLen += msglen;
 }
 
 /**
- * Writes status strings accumulated in a message buffer,
- * G.savebuf, from bufferStateParams() and other sources
- * to a tmpfs memory file, displayParams_file, once each
- * second. This file can be displayed in real time by
- * invoking the PPS-Client program with the -v command
- * line flag while the PPS-Client daemon is running.
+ * Publishes the state params and the status messages
+ * accumulated in a message buffer, G.savebuf, from
+ * bufferStateParams() and other sources to the shared
+ * memory status block once each second. The status
+ * can be displayed in real time by invoking the
+ * PPS-Client program with the -v command line flag
+ * while the PPS-Client daemon is running.
  *
  * @returns 0 on success, else -1 on error.
  */
 int writeStatusStrings(void){
 
-	int fSize = strlen(g.savebuf);
-
-	remove(f.displayParams_file);
-	int fd = open_logerr(f.displayParams_file, O_CREAT | O_WRONLY, "writeStatusStrings() 1");
-	if (fd == -1){
-		return -1;
-	}
-	int rv = write(fd, g.savebuf, fSize);
-	close(fd);
-	if (rv == -1){
-		sprintf(g.logbuf, "writeStatusStrings() Could not write to %s. Error: %s\n", f.displayParams_file, strerror(errno));
-		writeToLog(g.logbuf, "writeStatusStrings() 2");
-		return -1;
-	}
+	publishStatus(g.savebuf, g.hasStatusLine);
 
+	g.hasStatusLine = false;
 	g.savebuf[0] = '\0';
+	g.savebufLen = 0;
 	return 0;
 }
 
@@ -501,230 +572,201 @@ int open_logerr(const char* filename, int flags, const char *location){
 }
 
 /**
- * Saves the state corresponding to the makeTimeCorrection()
- * integrators on exit to allow rapid restart. These are
- * saved to /root/.pps-last-state on the RPi or whatever
- * the root home directory is on other processors.
+ * Computes the FNV-1a checksum of a checkpoint with
+ * its \b checksum field taken as zero.
  */
-int saveLastState(void){
-	char buf[500];
-
-	int fd = open_logerr(f.integral_state_file, O_CREAT | O_WRONLY, "saveLastState()");
-	if (fd == -1){
-		return -1;
-	}
+static uint32_t stateChecksum(const struct savedState *s){
+	struct savedState tmp = *s;
+	const uint8_t *p = (const uint8_t *)&tmp;
+	uint32_t h = 2166136261u;
 
-	memset(buf, 0, 500 * sizeof(char));
-	char *pbuf;
-	pbuf = buf;
-	for (int i = 0; i < NUM_INTEGRALS; i++){
-		sprintf(pbuf, "%lf\n", g.integral[i]);
-		while (*pbuf != '\0'){
-			pbuf += 1;
-		}
-	}
-
-	sprintf(pbuf, "%d\n", g.slewIsLow);
-	while (*pbuf != '\0'){
-		pbuf += 1;
-	}
-
-	sprintf(pbuf, "%lf\n", g.avgIntegral);
-	while (*pbuf != '\0'){
-		pbuf += 1;
-	}
-
-	sprintf(pbuf, "%d\n", g.integralCount);
-	while (*pbuf != '\0'){
-		pbuf += 1;
+	tmp.checksum = 0;
+	for (size_t i = 0; i < sizeof(struct savedState); i++){
+		h = (h ^ p[i]) * 16777619u;
 	}
+	return h;
+}
 
-	sprintf(pbuf, "%d\n", g.correctionFifo_idx);
-	while (*pbuf != '\0'){
-		pbuf += 1;
-	}
+/**
+ * Copies the controller state restored by loadLastState()
+ * into a checkpoint.
+ *
+ * @param[out] s The checkpoint.
+ */
+static void getSavedState(struct savedState *s){
+	memset(s, 0, sizeof(struct savedState));
+
+	s->magic = STATE_MAGIC;
+	s->version = STATE_VERSION;
+	s->size = sizeof(struct savedState);
+	s->savedAt = g.pps_t_sec;
+
+	memcpy(s->integral, g.integral, sizeof(s->integral));
+	s->avgIntegral = g.avgIntegral;
+	s->integralTimeCorrection = g.integralTimeCorrection;
+	s->freqOffset = g.freqOffset;
+	s->correctionAccum = g.correctionAccum;
+	memcpy(s->correctionFifo, g.correctionFifo, sizeof(s->correctionFifo));
+	s->correctionFifo_idx = g.correctionFifo_idx;
+	s->correctionFifoCount = g.correctionFifoCount;
+	s->integralCount = g.integralCount;
+	s->activeCount = g.activeCount;
+	s->seq_num = g.seq_num;
+	s->hardLimit = g.hardLimit;
+	s->usecScale = g.usecScale;
+	s->slewIsLow = g.slewIsLow;
+	s->isControlling = g.isControlling;
+
+	s->checksum = stateChecksum(s);
+}
 
-	sprintf(pbuf, "%lf\n", g.integralTimeCorrection);
-	while (*pbuf != '\0'){
-		pbuf += 1;
-	}
+/**
+ * Replaces the contents of a file so that the file always
+ * holds either the previous or the new contents whenever
+ * the daemon or the system stops. The contents are written
+ * to a temporary file that is synced and then renamed over
+ * the file. This function blocks on the file system and is
+ * called only by the writer thread or, after the controller
+ * has stopped, when the daemon exits.
+ *
+ * @param[in] filename The file.
+ * @param[in] buf The new contents.
+ * @param[in] len The length of the contents.
+ * @param[in] location The caller, for error messages.
+ * @param[out] logbuf Space for error messages.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int replaceFile(const char *filename, const void *buf, size_t len, const char *location, char *logbuf){
+	char tmpFile[sizeof(f.log_file) + 8];
+	char dirName[sizeof(f.log_file)];
+	mode_t mode = S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH;
 
-	for (int i = 0; i < OFFSETFIFO_LEN; i++){
-		sprintf(pbuf, "%d\n", g.correctionFifo[i]);
-		while (*pbuf != '\0'){
-			pbuf += 1;
-		}
-	}
+	snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", filename);
 
-	sprintf(pbuf, "%d\n", g.correctionFifoCount);
-	while (*pbuf != '\0'){
-		pbuf += 1;
+	int fd = open(tmpFile, O_CREAT | O_WRONLY | O_TRUNC, mode);
+	if (fd == -1){
+		couldNotOpenMsgTo(logbuf, tmpFile, location);
+		writeLogToFile(logbuf, time(NULL), true);
+		return -1;
 	}
 
-	sprintf(pbuf, "%d\n", g.correctionAccum);
-	while (*pbuf != '\0'){
-		pbuf += 1;
+	if (write(fd, buf, len) != (ssize_t)len || fsync(fd) == -1){
+		sprintf(logbuf, "%s Write to %s failed. Error: %s\n", location, tmpFile, strerror(errno));
+		writeLogToFile(logbuf, time(NULL), true);
+		close(fd);
+		remove(tmpFile);
+		return -1;
 	}
+	close(fd);
 
-	sprintf(pbuf, "%lf\n", g.freqOffset);
-	while (*pbuf != '\0'){
-		pbuf += 1;
+	if (rename(tmpFile, filename) == -1){
+		sprintf(logbuf, "%s Could not rename %s. Error: %s\n", location, tmpFile, strerror(errno));
+		writeLogToFile(logbuf, time(NULL), true);
+		remove(tmpFile);
+		return -1;
 	}
 
-	sprintf(pbuf, "%d\n", g.activeCount);
-	while (*pbuf != '\0'){
-		pbuf += 1;
+	snprintf(dirName, sizeof(dirName), "%s", filename);	// Sync the rename.
+	int dfd = open(dirname(dirName), O_RDONLY | O_DIRECTORY);
+	if (dfd != -1){
+		fsync(dfd);
+		close(dfd);
 	}
+	return 0;
+}
 
-	sprintf(pbuf, "%d\n", g.seq_num);
-	while (*pbuf != '\0'){
-		pbuf += 1;
-	}
+/**
+ * Writes a checkpoint to the state file with replaceFile().
+ *
+ * @param[in] s The checkpoint.
+ * @param[out] logbuf Space for error messages.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int writeStateFile(const struct savedState *s, char *logbuf){
+	return replaceFile(f.integral_state_file, s, sizeof(struct savedState), "writeStateFile()", logbuf);
+}
 
-	sprintf(pbuf, "%d\n", (int)g.isControlling);
-	while (*pbuf != '\0'){
-		pbuf += 1;
-	}
+/**
+ * Queues a checkpoint of the controller state to the writer
+ * thread every STATE_SAVE_INTERVAL seconds while the controller
+ * is controlling so that a restart after any kind of termination
+ * can restore a recent state.
+ */
+void checkpointState(void){
+	struct savedState s;
 
-	sprintf(pbuf, "%d\n", g.hardLimit);
-	while (*pbuf != '\0'){
-		pbuf += 1;
+	if (! g.isControlling || g.startingFromRestore != 0 || g.seq_num % STATE_SAVE_INTERVAL != 0){
+		return;
 	}
+	getSavedState(&s);
+	queueState(&s);
+}
 
-	int rv = write(fd, buf, strlen(buf) + 1);
-
-	close(fd);
+/**
+ * Saves the state corresponding to the makeTimeCorrection()
+ * integrators on exit to allow rapid restart.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int saveLastState(void){
+	struct savedState s;
 
-	if (rv == -1){
-		sprintf(g.logbuf, "saveLastState() Write to %s failed\n", integral_state_file);
-		writeToLog(g.logbuf, "daemonSaveArray()");
-		return -1;
-	}
-	return 0;
+	getSavedState(&s);
+	return writeStateFile(&s, g.logbuf);
 }
 
 /**
  * Loads the last state corresponding to the makeTimeCorrection()
- * integrators on startup to allow rapid restart.
+ * integrators on startup to allow rapid restart. A state file
+ * that is missing, of another version or that fails its checksum
+ * is ignored.
+ *
+ * @returns 0 if the state was restored, 1 if it was not, else -1
+ * on error.
  */
 int loadLastState(void){
-	char buf[500];
+	struct savedState s;
 
 	int fd = open(f.integral_state_file, O_RDONLY);
 	if (fd == -1){
 		return 1;
 	}
 
-	int rv = read_logerr(fd, buf, 499, integral_state_file);
+	int rv = read_logerr(fd, (char *)&s, sizeof(struct savedState), integral_state_file);
+	close(fd);
 	if (rv == -1){
 		return -1;
 	}
-	close(fd);
-
-	char *pbuf = buf;
 
-	for (int i = 0; i < NUM_INTEGRALS; i++){
-		sscanf(pbuf, "%lf\n", &g.integral[i]);
-
-		while (*pbuf != '\n'){
-			pbuf += 1;
-		}
-		pbuf += 1;
-	}
-
-	int b;
-	sscanf(pbuf, "%d\n", &b);
-	g.slewIsLow = false;
-	if (b > 0){
-		g.slewIsLow = true;
-	}
-
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	sscanf(pbuf, "%lf\n", &g.avgIntegral);
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	sscanf(pbuf, "%d\n", &g.integralCount);
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	sscanf(pbuf, "%d\n", &g.correctionFifo_idx);
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	sscanf(pbuf, "%lf\n", &g.integralTimeCorrection);
-	while (*pbuf != '\n'){
-		pbuf += 1;
+	if (rv != sizeof(struct savedState) || s.magic != STATE_MAGIC || s.version != STATE_VERSION
+			|| s.size != sizeof(struct savedState) || s.checksum != stateChecksum(&s)){
+		sprintf(g.logbuf, "loadLastState() Ignoring %s, which is not a valid saved state\n", f.integral_state_file);
+		writeToLog(g.logbuf, "loadLastState()");
+		return 1;
 	}
-	pbuf += 1;
-
-	for (int i = 0; i < OFFSETFIFO_LEN; i++){
-		sscanf(pbuf, "%d\n", &g.correctionFifo[i]);
 
-		while (*pbuf != '\n'){
-			pbuf += 1;
+	memcpy(g.integral, s.integral, sizeof(g.integral));
+	g.avgIntegral = s.avgIntegral;
+	g.integralTimeCorrection = s.integralTimeCorrection;
+	g.correctionAccum = s.correctionAccum;
+	memcpy(g.correctionFifo, s.correctionFifo, sizeof(g.correctionFifo));
+	g.correctionFifo_idx = s.correctionFifo_idx;
+	g.correctionFifoCount = s.correctionFifoCount;
+	g.integralCount = s.integralCount;
+	g.activeCount = s.activeCount;
+	g.seq_num = s.seq_num;
+	g.hardLimit = s.hardLimit;
+	g.slewIsLow = s.slewIsLow;
+	g.isControlling = s.isControlling;
+
+	if (s.usecScale > 0 && s.usecScale != g.usecScale){		// Convert the saved corrections to the current units.
+		for (int i = 0; i < OFFSETFIFO_LEN; i++){
+			g.correctionFifo[i] = (int)((int64_t)g.correctionFifo[i] * g.usecScale / s.usecScale);
 		}
-		pbuf += 1;
-	}
-
-	sscanf(pbuf, "%d\n", &g.correctionFifoCount);
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	sscanf(pbuf, "%d\n", &g.correctionAccum);
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	sscanf(pbuf, "%lf\n", &g.freqOffset);
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	sscanf(pbuf, "%d\n", &g.activeCount);
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	sscanf(pbuf, "%d\n", &g.seq_num);
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	int t_f;
-	sscanf(pbuf, "%d\n", &t_f);
-	if (t_f == 0){
-		g.isControlling = false;
-	}
-	else {
-		g.isControlling = true;
-	}
-	while (*pbuf != '\n'){
-		pbuf += 1;
-	}
-	pbuf += 1;
-
-	sscanf(pbuf, "%d\n", &g.hardLimit);
-	while (*pbuf != '\n'){
-		pbuf += 1;
+		g.correctionAccum = g.correctionAccum * g.usecScale / s.usecScale;
 	}
-	pbuf += 1;
 
 	g.startingFromRestore = SECS_PER_MINUTE;
 
@@ -732,7 +774,7 @@ int loadLastState(void){
 
 	g.t3.modes = ADJ_FREQUENCY;
 	g.t3.freq = (long)round(ADJTIMEX_SCALE * g.freqOffset);
-	adjtimex(&g.t3);							// Adjust the system clock frequency.
+	clk->adjustClock(&g.t3);					// Adjust the system clock frequency.
 
 	return 0;
 }
@@ -904,179 +946,388 @@ int createPIDfile(void){
 }
 
 /**
- * Reads the PPS-Client config file and sets bits
- * in G.config_select to 1 or 0 corresponding to
- * whether a particular G.configVals appears in the
- * config file. The G.configVals from the file is then
- * copied to fbuf and a pointer to that string is
- * placed in the G.configVals array.
+ * Parses a config value string into cv.
  *
- * If the G.configVals did not occur in the config file
- * then G.configVals has a NULL char* in the corresponding
- * location.
- *
- * @param[in] fconfig Root filename of pps-client.conf.
- *
- * @returns 0 on success, else -1 on error.
+ * @param[in] str The value string.
+ * @param[out] cv The parsed value.
  */
-int readConfigFile(const char *fconfig){
+static void parseConfigValue(const char *str, struct configValue *cv){
+	char *end;
 
-	struct stat stat_buf;
+	cv->str = str;
 
-	int rvs = stat(fconfig, &configFileStat);
-	if (rvs == -1){
-		sprintf(g.logbuf, "readConfigFile(): Config file not found.\n");
-		writeToLog(g.logbuf, "readConfigFile()");
-		return -1;									// No config file
+	if (strstr(str, "enable") != NULL){
+		cv->state = CONFIG_ENABLED;
 	}
-
-	timespec t = configFileStat.st_mtim;
-
-	if (g.configWasRead && g.seq_num > 0 && modifyTime == t.tv_sec){
-		return 1;									// Config file unchanged from last read
+	else if (strstr(str, "disable") != NULL){
+		cv->state = CONFIG_DISABLED;
+	}
+	else {
+		cv->state = CONFIG_OTHER;
 	}
 
-	modifyTime = t.tv_sec;
+	errno = 0;
+	long v = strtol(str, &end, 10);
+	cv->isInt = (end != str && *end == '\0' && errno == 0);
+	cv->intVal = cv->isInt ? (int)v : 0;
+}
 
-	int fd = open_logerr(fconfig, O_RDONLY, "readConfigFile()");
+/**
+ * Reads the PPS-Client config file into a config snapshot
+ * and sets bits in config_select to 1 or 0 corresponding to
+ * whether a particular config key appears in the config file.
+ * The value following each key that is present is parsed into
+ * the vals array at the index of the key bit.
+ *
+ * Each "key=value" line is split in place and the key is
+ * matched exactly against valid_config[]. The first line
+ * for a key is used. Blank lines and lines starting with
+ * '#' are ignored.
+ *
+ * @param[in] fconfig Root filename of pps-client.conf.
+ * @param[out] cs The config snapshot to fill.
+ * @param[out] logbuf Space for an error message.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int readConfigFile(const char *fconfig, struct configSnapshot *cs, char *logbuf){
+	struct stat stat_buf;
+
+	int fd = open(fconfig, O_RDONLY);
 	if (fd == -1){
-		return -1;
+		sprintf(logbuf, "readConfigFile(): Config file not found.\n");
+		writeLogToFile(logbuf, time(NULL), true);
+		return -1;										// No config file
 	}
 
 	fstat(fd, &stat_buf);
 	int sz = stat_buf.st_size;
 
 	if (sz >= CONFIG_FILE_SZ){
-		sprintf(g.logbuf, "readConfigFile(): not enough space allocated for config file.\n");
-		writeToLog(g.logbuf, "readConfigFile()");
+		close(fd);
+		sprintf(logbuf, "readConfigFile(): not enough space allocated for config file.\n");
+		writeLogToFile(logbuf, time(NULL), true);
 		return -1;
 	}
 
-	int rv = read_logerr(fd, g.configBuf, sz, fconfig);
-	if (rv == -1 || sz != rv){
+	int rv = read(fd, cs->configBuf, sz);
+	close(fd);
+	if (rv != sz){
+		sprintf(logbuf, "readConfigFile(): Error reading %s: %s\n", fconfig, strerror(errno));
+		writeLogToFile(logbuf, time(NULL), true);
 		return -1;
 	}
-	close(fd);
+	cs->configBuf[sz] = '\0';
 
-	g.configBuf[sz] = '\0';
+	int nValidCnfgs = sizeof(valid_config) / sizeof(char *);
 
-	int nCfgStrs = 0;
-	int i;
+	cs->config_select = 0;
+	memset(cs->vals, 0, sizeof(cs->vals));
 
-	char *pToken = strtok(g.configBuf, "\n");			// Separate tokens at "\n".
+	char *line = cs->configBuf;
+	while (*line != '\0'){
+		char *eol = strchr(line, '\n');
+		char *next = (eol == NULL) ? line + strlen(line) : eol + 1;
+		if (eol != NULL){
+			*eol = '\0';
+		}
 
-	while (pToken != NULL){
-		if (strlen(pToken) != 0){						// If not a blank line.
-			for (int j = 0; j < 10; j++){				// Skip leading spaces.
-				if (pToken[0] == ' '){
-					pToken += 1;
-				}
-				else {
-					break;								// Break on first non-space character.
-				}
+		while (*line == ' ' || *line == '\t'){			// Skip leading spaces.
+			line += 1;
+		}
+
+		char *eq = strchr(line, '=');
+		if (line[0] != '#' && eq != NULL){				// Ignore blank and comment lines.
+			char *value = eq + 1;
+			while (*value == ' ' || *value == '\t'){
+				value += 1;
+			}
+
+			char *p = eq;								// Trim the key and the value.
+			while (p > line && (p[-1] == ' ' || p[-1] == '\t')){
+				p -= 1;
 			}
+			*p = '\0';
 
-			if (pToken[0] != '#'){						// Ignore comment lines.
-				g.configVals[nCfgStrs] = pToken;
-				nCfgStrs += 1;
+			p = value + strlen(value);
+			while (p > value && (p[-1] == ' ' || p[-1] == '\t' || p[-1] == '\r')){
+				p -= 1;
+			}
+			*p = '\0';
+
+			for (int i = 0; i < nValidCnfgs; i++){
+				if (strcmp(line, valid_config[i]) == 0){
+					if ((cs->config_select & (1 << i)) == 0){
+						cs->config_select |= 1 << i;	// Set a bit in config_select
+						parseConfigValue(value, &cs->vals[i]);
+					}
+					break;
+				}
 			}
 		}
-		pToken = strtok(NULL, "\n");					// Get the next token.
+		line = next;
 	}
 
-	if (nCfgStrs == 0){
-		return 0;
+	return 0;
+}
+
+/**
+ * Reads the config file directly into the snapshot used
+ * by getString() and related functions. Used only before
+ * the config watcher thread is started.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+static int loadActiveConfig(void){
+
+	if (readConfigFile(config_file, &cf.snap[cf.front], g.logbuf) == -1){
+		return -1;
 	}
+	cf.active = &cf.snap[cf.front];
+	return 0;
+}
 
-	for (i = 0; i < nCfgStrs; i++){						// Compact g.configBuf to remove string terminators inserted by
-		if (i == 0){									// strtok() so that g.configBuf can be searched as a single string.
-			strcpy(g.configBuf, g.configVals[i]);
-		}
-		else {
-			strcat(g.configBuf, g.configVals[i]);
-		}
-		strcat(g.configBuf, "\n");
+/**
+ * If the config watcher thread has published a new config
+ * snapshot, swaps it into use.
+ *
+ * @returns "true" if a new snapshot is now in use.
+ */
+static bool swapConfigSnapshot(void){
+
+	if ((cf.middle.load(std::memory_order_relaxed) & CONFIG_DIRTY) == 0){
+		return false;
 	}
 
-	int nValidCnfgs = sizeof(valid_config) / sizeof(char *);
+	int idx = cf.middle.exchange(cf.front, std::memory_order_acq_rel);
+	cf.front = idx & ~CONFIG_DIRTY;
+	cf.active = &cf.snap[cf.front];
+	return true;
+}
 
-	char **configVal = g.configVals;					// Use g.configVals to return pointers to value strings
-	char *value;
+/**
+ * Parses the config file into the back snapshot and
+ * publishes it to getConfigs().
+ */
+static void publishConfigSnapshot(void){
 
-	for (i = 0; i < nValidCnfgs; i++){
+	if (readConfigFile(config_file, &cf.snap[cf.back], cf.logbuf) == -1){
+		return;											// Keep using the previous config.
+	}
 
-		char *found = strstr(g.configBuf, valid_config[i]);
-		if (found != NULL){
-			g.config_select |= 1 << i;					// Set a bit in g.config_select
+	int idx = cf.middle.exchange(cf.back | CONFIG_DIRTY, std::memory_order_acq_rel);
+	cf.back = idx & ~CONFIG_DIRTY;
+}
 
-			value = strpbrk(found, "=");				// Get the value string following '='.
-			value += 1;
+/**
+ * Waits for changes to the config file and publishes
+ * a new config snapshot for each change.
+ */
+static void *configWatcherThread(void *arg){
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct pollfd fds[2];
+	char name[100];
+
+	strcpy(name, config_file);
+	const char *base = basename(name);
+
+	publishConfigSnapshot();							// Catch a change made before the watch was added.
+
+	fds[0].fd = cf.inotifyFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = cf.stopFd;
+	fds[1].events = POLLIN;
 
-			configVal[i] = value;						// Point to g.configVals[i] value string in g.configBuf
+	for (;;){
+		if (poll(fds, 2, -1) == -1){
+			if (errno == EINTR){
+				continue;
+			}
+			break;
 		}
-		else {
-			g.config_select &= ~(1 << i);				// Clear a bit in config_select
-			configVal[i] = NULL;
+		if (fds[1].revents != 0){						// stopConfigWatcher()
+			break;
 		}
-	}
 
-	for (i = 0; i < nValidCnfgs; i++){					// Replace the "\n" at the end of each value
-		if (configVal[i] != NULL){						// string with a string terminator.
-			value = strpbrk(configVal[i], "\n");
-			if (value != NULL){
-				*value = 0;
+		int n = read(cf.inotifyFd, buf, sizeof(buf));
+		if (n <= 0){
+			continue;
+		}
+
+		bool changed = false;
+		for (char *p = buf; p < buf + n; ){
+			struct inotify_event *ev = (struct inotify_event *)p;
+			if (ev->len > 0 && strcmp(ev->name, base) == 0){
+				changed = true;
 			}
+			p += sizeof(struct inotify_event) + ev->len;
+		}
+
+		if (changed){
+			publishConfigSnapshot();
 		}
 	}
+	return NULL;
+}
+
+/**
+ * Starts a thread that watches the config file directory
+ * with inotify so that the controller never has to check
+ * the config file for changes.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int startConfigWatcher(void){
+	char dir[100];
 
-	if (g.seq_num > 0){
-		g.configWasRead = true;							// Insures that config file read at least once.
+	if (cf.isRunning){
+		return 0;
 	}
 
+	strcpy(dir, config_file);
+	dirname(dir);
+
+	cf.inotifyFd = inotify_init1(IN_CLOEXEC);
+	cf.stopFd = eventfd(0, EFD_CLOEXEC);
+	if (cf.inotifyFd == -1 || cf.stopFd == -1){
+		sprintf(g.logbuf, "startConfigWatcher(): Can't create inotify watch: %s\n", strerror(errno));
+		writeToLog(g.logbuf, "startConfigWatcher()");
+		goto fail;
+	}
+															// Watch the directory because editors
+	if (inotify_add_watch(cf.inotifyFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1){	// often replace the file.
+		sprintf(g.logbuf, "startConfigWatcher(): Can't watch %s: %s\n", dir, strerror(errno));
+		writeToLog(g.logbuf, "startConfigWatcher()");
+		goto fail;
+	}
+
+	{
+		int rv = createNormalThread(&cf.tid, &configWatcherThread, NULL, CONFIG_STACK_SZ);
+		if (rv != 0){
+			sprintf(g.logbuf, "Can't create config watcher thread : %s\n", strerror(rv));
+			writeToLog(g.logbuf, "startConfigWatcher()");
+			goto fail;
+		}
+	}
+
+	cf.isRunning = true;
 	return 0;
+
+fail:
+	if (cf.inotifyFd != -1){
+		close(cf.inotifyFd);
+		cf.inotifyFd = -1;
+	}
+	if (cf.stopFd != -1){
+		close(cf.stopFd);
+		cf.stopFd = -1;
+	}
+	return -1;
 }
 
 /**
- * Writes an accumulating statistical distribution to disk and
- * rolls over the accumulating data to a new file every epoch
- * counts and begins a new distribution file. An epoch is
- * 86,400 counts.
+ * Stops the config watcher thread.
+ */
+void stopConfigWatcher(void){
+	uint64_t one = 1;
+
+	if (! cf.isRunning){
+		return;
+	}
+	cf.isRunning = false;
+
+	if (write(cf.stopFd, &one, sizeof(one)) == -1){
+		;
+	}
+	pthread_join(cf.tid, NULL);
+
+	close(cf.inotifyFd);
+	close(cf.stopFd);
+	cf.inotifyFd = -1;
+	cf.stopFd = -1;
+}
+
+/**
+ * Writes a statistical distribution to distrib_file and,
+ * if rollover is "true", moves it to last_distrib_file.
  *
  * @param[in] distrib The array containing the distribution.
  * @param[in] len The length of the array.
  * @param[in] scaleZero The array index corresponding to distribution zero.
- * @param[in] count The current number of samples in the distribution.
- * @param[out] last_epoch The saved count of the previous epoch.
- * @param[in] distrib_file The filename of the last completed
- * distribution file.
- * @param[in] last_distrib_file The filename of the currently
+ * @param[in] rollover "true" at the end of an epoch.
+ * @param[in] distrib_file The filename of the currently
  * forming distribution file.
+ * @param[in] last_distrib_file The filename of the last
+ * completed distribution file.
+ * @param[out] logbuf Space for an error message.
  */
-void writeDistribution(int distrib[], int len, int scaleZero, int count,
-		int *last_epoch, const char *distrib_file, const char *last_distrib_file){
-	int rv = 0;
+void writeDistributionFile(const int *distrib, int len, int scaleZero, bool rollover,
+		const char *distrib_file, const char *last_distrib_file, char *logbuf){
+	char linebuf[50];
+	mode_t mode = S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH;
+
 	remove(distrib_file);
-	int fd = open_logerr(distrib_file, O_CREAT | O_WRONLY | O_APPEND, "writeDistribution()");
+	int fd = open(distrib_file, O_CREAT | O_WRONLY | O_APPEND, mode);
 	if (fd == -1){
+		couldNotOpenMsgTo(logbuf, distrib_file, "writeDistributionFile()");
+		writeLogToFile(logbuf, time(NULL), true);
 		return;
 	}
 	for (int i = 0; i < len; i++){
-		sprintf(g.strbuf, "%d %d\n", i-scaleZero, distrib[i]);
-		rv = write(fd, g.strbuf, strlen(g.strbuf));
+		sprintf(linebuf, "%d %d\n", i-scaleZero, distrib[i]);
+		int rv = write(fd, linebuf, strlen(linebuf));
 		if (rv == -1){
-			sprintf(g.logbuf, "writeDistribution() Unable to write to %s. Error: %s\n", distrib_file, strerror(errno));
-			writeToLog(g.logbuf, "writeDistribution()");
+			sprintf(logbuf, "writeDistributionFile() Unable to write to %s. Error: %s\n", distrib_file, strerror(errno));
+			writeLogToFile(logbuf, time(NULL), true);
 			close(fd);
 			return;
 		}
 	}
 	close(fd);
 
+	if (rollover){
+		remove(last_distrib_file);
+		rename(distrib_file, last_distrib_file);
+	}
+}
+
+/**
+ * Writes an accumulating statistical distribution to disk and
+ * rolls over the accumulating data to a new file every epoch
+ * counts and begins a new distribution file. An epoch is
+ * 86,400 counts.
+ *
+ * The file write is passed to the writer thread along with
+ * a copy of the distribution. It is made here only if the
+ * writer thread is not running. If the queue of the writer
+ * thread is full, the write is skipped.
+ *
+ * @param[in] distrib The array containing the distribution.
+ * @param[in] len The length of the array.
+ * @param[in] scaleZero The array index corresponding to distribution zero.
+ * @param[in] count The current number of samples in the distribution.
+ * @param[out] last_epoch The saved count of the previous epoch.
+ * @param[in] distrib_file The filename of the last completed
+ * distribution file.
+ * @param[in] last_distrib_file The filename of the currently
+ * forming distribution file.
+ */
+void writeDistribution(int distrib[], int len, int scaleZero, int count,
+		int *last_epoch, const char *distrib_file, const char *last_distrib_file){
+
+	bool rollover = false;
+
 	int epoch = count / SECS_PER_DAY;
 	if (epoch != *last_epoch ){
 		*last_epoch = epoch;
-		remove(last_distrib_file);
-		rename(distrib_file, last_distrib_file);
+		rollover = true;
+	}
+
+	if (queueDistrib(distrib, len, scaleZero, rollover, distrib_file, last_distrib_file) == -1){
+		writeDistributionFile(distrib, len, scaleZero, rollover, distrib_file, last_distrib_file, g.logbuf);
+	}
+
+	if (rollover){
 		memset(distrib, 0, len * sizeof(int));
 	}
 }
@@ -1109,30 +1360,59 @@ void writeErrorDistribFile(void){
 	}
 }
 
+/**
+ * Appends line to a packet buffer, first writing the
+ * buffer to fd if line would not fit. Writing to a
+ * SOCK_SEQPACKET socket sends each buffer as one packet.
+ *
+ * @param[in] fd The file or socket to write to.
+ * @param[in,out] buf The packet buffer of size CTL_PACKET_SZ.
+ * @param[in,out] len The length of the data in buf.
+ * @param[in] line The line to append or NULL to write
+ * any data remaining in buf.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+static int appendLine(int fd, char *buf, int *len, const char *line){
+	int n = (line == NULL) ? 0 : strlen(line);
+
+	if (*len > 0 && (line == NULL || *len + n > CTL_PACKET_SZ)){
+		if (write(fd, buf, *len) == -1){
+			return -1;
+		}
+		*len = 0;
+	}
+	if (line != NULL){
+		memcpy(buf + *len, line, n);
+		*len += n;
+	}
+	return 0;
+}
+
 /**
  * Writes the previously completed list of 10 minutes of recorded
  * time offsets and applied frequency offsets indexed by seq_num.
  *
- * @param[in] filename The file to write to.
+ * @param[in] fd The file or socket to write to.
+ *
+ * @returns 0 on success, else -1 on error.
  */
-void writeOffsets(const char *filename){
-	int fd = open_logerr(filename, O_CREAT | O_WRONLY | O_TRUNC, "writeOffsets()");
-	if (fd == -1){
-		return;
-	}
+int writeOffsetsTo(int fd){
+	char buf[CTL_PACKET_SZ];
+	char line[MAX_LINE_LEN];
+	int len = 0;
+
 	for (int i = 0; i < SECS_PER_10_MIN; i++){
 		int j = g.recIndex2 + i;
 		if (j >= SECS_PER_10_MIN){
 			j -= SECS_PER_10_MIN;
 		}
-		sprintf(g.strbuf, "%d %d %lf\n", g.seq_numRec[j], g.offsetRec[j], g.freqOffsetRec2[j]);
-		int rv = write(fd, g.strbuf, strlen(g.strbuf));
-		if (rv == -1){
-			sprintf(g.logbuf, "writeOffsets() Unable to write to %s. Error: %s\n", filename, strerror(errno));
-			writeToLog(g.logbuf, "writeOffsets()");
+		snprintf(line, MAX_LINE_LEN, "%d %d %lf\n", g.seq_numRec[j], g.offsetRec[j], g.freqOffsetRec2[j]);
+		if (appendLine(fd, buf, &len, line) == -1){
+			return -1;
 		}
 	}
-	close(fd);
+	return appendLine(fd, buf, &len, NULL);
 }
 
 /**
@@ -1140,129 +1420,87 @@ void writeOffsets(const char *filename){
  * deviation in each 5 minute interval indexed by the timestamp
  * at each interval.
  *
- * @param[in] filename The file to write to.
+ * @param[in] fd The file or socket to write to.
+ *
+ * @returns 0 on success, else -1 on error.
  */
-void writeFrequencyVars(const char *filename){
-	int fd = open_logerr(filename, O_CREAT | O_WRONLY | O_TRUNC, "writeFrequencyVars()");
-	if (fd == -1){
-		return;
-	}
+int writeFrequencyVarsTo(int fd){
+	char buf[CTL_PACKET_SZ];
+	char line[MAX_LINE_LEN];
+	int len = 0;
+
 	for (int i = 0; i < NUM_5_MIN_INTERVALS; i++){
 		int j = g.recIndex + i;							// Read the circular buffers relative to g.recIndx.
 		if (j >= NUM_5_MIN_INTERVALS){
 			j -= NUM_5_MIN_INTERVALS;
 		}
-		sprintf(g.strbuf, "%ld %lf %lf\n", g.timestampRec[j], g.freqOffsetRec[j], g.freqAllanDev[j]);
-		int rv = write(fd, g.strbuf, strlen(g.strbuf));
-		if (rv == -1){
-			sprintf(g.logbuf, "writeFrequencyVars() Write to %s failed with error: %s\n", filename, strerror(errno));
-			writeToLog(g.logbuf, "writeFrequencyVars");
-			close(fd);
-			return;
+		snprintf(line, MAX_LINE_LEN, "%ld %lf %lf\n", g.timestampRec[j], g.freqOffsetRec[j], g.freqAllanDev[j]);
+		if (appendLine(fd, buf, &len, line) == -1){
+			return -1;
 		}
 	}
-	close(fd);
+	return appendLine(fd, buf, &len, NULL);
 }
 
 /**
- * Saves a distribution consisting of an array of doubles.
+ * Writes a distribution consisting of an array of doubles.
+ * The values of a decaying distribution are normalized to
+ * a sample weight of 1 as they are written.
  *
+ * @param[in] fd The file or socket to write to.
  * @param[in] distrib The distribution array.
- * @param[in] filename The file to save to.
  * @param[in] len The length of the array.
  * @param[in] arrayZero The array index of distribution value zero.
+ * @param[in] weight The sample weight of a decaying distribution
+ * or NULL.
  *
  * @returns 0 on success, else -1 on error.
  */
-int saveDoubleArray(double distrib[], const char *filename, int len, int arrayZero){
+int writeDoubleArrayTo(int fd, const double distrib[], int len, int arrayZero, const double *weight){
+	char buf[CTL_PACKET_SZ];
+	char line[MAX_LINE_LEN];
+	int bufLen = 0;
 
-	int fd = open_logerr(filename, O_CREAT | O_WRONLY | O_TRUNC, "saveDoubleArray()");
-	if (fd == -1){
-		return -1;
+	double scale = 1.0;
+	if (weight != NULL && *weight > 0.0){
+		scale = 1.0 / *weight;
 	}
 
-	int fileMaxLen = len * MAX_LINE_LEN * sizeof(char);
-	char *filebuf = new char[fileMaxLen];
-	int fileLen = 0;
-
-	filebuf[0] = '\0';
 	for (int i = 0; i < len; i++){
-		sprintf(g.strbuf, "%d %7.2lf\n", i - arrayZero, distrib[i]);
-		fileLen += strlen(g.strbuf);
-		strcat(filebuf, g.strbuf);
-	}
-
-	int rv = write(fd, filebuf, fileLen + 1);
-	if (rv == -1){
-		sprintf(g.logbuf, "saveDoubleArray() Write to %s failed with error: %s\n", filename, strerror(errno));
-		writeToLog(g.logbuf, "saveDoubleArray()");
-		return -1;
+		snprintf(line, MAX_LINE_LEN, "%d %7.2lf\n", i - arrayZero, distrib[i] * scale);
+		if (appendLine(fd, buf, &bufLen, line) == -1){
+			return -1;
+		}
 	}
-
-	fsync(fd);
-
-	delete[] filebuf;
-	close(fd);
-	return 0;
+	return appendLine(fd, buf, &bufLen, NULL);
 }
 
 /**
- * From within the daemon, reads the data label and filename
- * of an array to write to disk from a request made from the
- * command line with "pps-client -s [label] <filename>".
- * Then matches the requestStr to the corresponding arrayData
- * which is then passed to a routine that saves the array
- * identified by the data label.
+ * Writes the distributions of the time from the wakeup
+ * of the one-second loop to the end of each phase of the
+ * work done for a PPS. Each line holds the lower edge of
+ * a latency bin in microseconds followed by the count in
+ * that bin for the fetch, correction, status and config
+ * phases. The last bin counts all larger latencies.
  *
- * @returns 0 on success else -1 on fail.
+ * @param[in] fd The file or socket to write to.
+ *
+ * @returns 0 on success, else -1 on error.
  */
-int processWriteRequest(void){
-	struct stat buf;
-
-	int rv = stat(f.arrayData_file, &buf);			// stat() used only to check that there is an arrayData_file
-	if (rv == -1){
-		return 0;
-	}
-
-	int fd = open(f.arrayData_file, O_RDONLY);
-	if (fd == -1){
-		sprintf(g.logbuf, "processWriteRequest() Unable to open %s. Error: %s\n", f.arrayData_file, strerror(errno));
-		writeToLog(g.logbuf, "processWriteRequest()");
-		return -1;
-	}
-
-	char requestStr[25];
-	char filename[225];
-
-	filename[0] = '\0';
-	rv = read(fd, g.strbuf, STRBUF_SZ-1);
-	sscanf(g.strbuf, "%s %s", requestStr, filename);
-
-	close(fd);
-	remove(f.arrayData_file);
-
-	int arrayLen = sizeof(arrayData) / sizeof(struct saveFileData);
-	for (int i = 0; i < arrayLen; i++){
-		if (strcmp(requestStr, arrayData[i].label) == 0){
-			if (strlen(filename) == 0){
-				strcpy(filename, arrayData[i].filename);
-			}
-			if (arrayData[i].arrayType == 2){
-				saveDoubleArray((double *)arrayData[i].array, filename, arrayData[i].arrayLen, arrayData[i].arrayZero);
-				break;
-			}
-			if (arrayData[i].arrayType == 3){
-				writeFrequencyVars(filename);
-				break;
-			}
-			if (arrayData[i].arrayType == 4){
-				writeOffsets(filename);
-				break;
-			}
-
+int writePhaseLatencyTo(int fd){
+	char buf[CTL_PACKET_SZ];
+	char line[MAX_LINE_LEN];
+	int len = 0;
+
+	for (int i = 0; i < PHASE_DISTRIB_LEN; i++){
+		snprintf(line, MAX_LINE_LEN, "%d %d %d %d %d\n", i * PHASE_BIN_USEC,
+				g.phaseDistrib[PPS_PHASE_FETCH][i], g.phaseDistrib[PPS_PHASE_CORRECTION][i],
+				g.phaseDistrib[PPS_PHASE_STATUS][i], g.phaseDistrib[PPS_PHASE_CONFIG][i]);
+		if (appendLine(fd, buf, &len, line) == -1){
+			return -1;
 		}
 	}
-	return 0;
+	return appendLine(fd, buf, &len, NULL);
 }
 
 /**
@@ -1272,29 +1510,29 @@ int processWriteRequest(void){
  */
 int getSharedConfigs(void){
 
-	int rv = readConfigFile(config_file);
+	int rv = loadActiveConfig();
 	if (rv == -1){
 		return rv;
 	}
 
-	char *sp;
+	const char *sp;
 
 	sp = getString(RUNDIR);
 	if (sp != NULL){
 		strcpy(f.pidFilename, sp);
 		strcat(f.pidFilename, pidFilename);
+
+		strcpy(f.control_socket, sp);
+		strcat(f.control_socket, control_socket);
 	}
 
 	sp = getString(SHMDIR);
 	if (sp != NULL){
-		strcpy(f.assert_file, sp);
-		strcat(f.assert_file, assert_file);
+		strcpy(f.timestamp_file, sp);
+		strcat(f.timestamp_file, timestamp_file);
 
-		strcpy(f.displayParams_file, sp);
-		strcat(f.displayParams_file, displayParams_file);
-
-		strcpy(f.arrayData_file, sp);
-		strcat(f.arrayData_file, arrayData_file);
+		strcpy(f.status_file, sp);
+		strcat(f.status_file, status_file);
 
 		strcpy(f.pps_msg_file, sp);
 		strcat(f.pps_msg_file, pps_msg_file);
@@ -1308,6 +1546,9 @@ int getSharedConfigs(void){
 		strcpy(f.distrib_file, sp);
 		strcat(f.distrib_file, distrib_file);
 
+		strcpy(f.history_file, sp);
+		strcat(f.history_file, history_file);
+
 		strcpy(f.last_jitter_distrib_file, sp);
 		strcat(f.last_jitter_distrib_file, last_jitter_distrib_file);
 
@@ -1322,6 +1563,9 @@ int getSharedConfigs(void){
 
 		strcpy(f.old_log_file, sp);
 		strcat(f.old_log_file, old_log_file);
+
+		strcpy(f.journal_file, sp);
+		strcat(f.journal_file, journal_file);
 	}
 
 	g.doNISTsettime = true;
@@ -1387,22 +1631,21 @@ int getConfigs(void){
 		writeJitterDistribFile();
 	}
 
-	int rv = processWriteRequest();
-	if (rv == -1){
-		return rv;
-	}
-
 	//****************************************************************
 
-	rv = readConfigFile(config_file);
-	if (rv == -1){
-		return rv;
+	if (cf.active == NULL){				// First read, before the config watcher is started.
+		if (loadActiveConfig() == -1){
+			return -1;
+		}
 	}
-	if (rv == 1){						// Skip reading again if rv == 1
-		return 0;
+	else if (! swapConfigSnapshot() && g.configWasRead){
+		return 0;						// Config unchanged since it was last applied
 	}
+	g.configWasRead = true;
+
+	int rv;
 
-	char *sp;
+	const char *sp;
 	struct stat dirStat;
 
 	sp = getString(RUNDIR);
@@ -1416,6 +1659,9 @@ int getConfigs(void){
 
 		strcpy(f.pidFilename, sp);
 		strcat(f.pidFilename, pidFilename);
+
+		strcpy(f.control_socket, sp);
+		strcat(f.control_socket, control_socket);
 	}
 
 	sp = getString(SHMDIR);
@@ -1427,14 +1673,11 @@ int getConfigs(void){
 			return rv;
 		}
 
-		strcpy(f.assert_file, sp);
-		strcat(f.assert_file, assert_file);
-
-		strcpy(f.displayParams_file, sp);
-		strcat(f.displayParams_file, displayParams_file);
+		strcpy(f.timestamp_file, sp);
+		strcat(f.timestamp_file, timestamp_file);
 
-		strcpy(f.arrayData_file, sp);
-		strcat(f.arrayData_file, arrayData_file);
+		strcpy(f.status_file, sp);
+		strcat(f.status_file, status_file);
 
 		strcpy(f.pps_msg_file, sp);
 		strcat(f.pps_msg_file, pps_msg_file);
@@ -1464,6 +1707,9 @@ int getConfigs(void){
 		strcpy(f.distrib_file, sp);
 		strcat(f.distrib_file, distrib_file);
 
+		strcpy(f.history_file, sp);
+		strcat(f.history_file, history_file);
+
 		strcpy(f.last_jitter_distrib_file, sp);
 		strcat(f.last_jitter_distrib_file, last_jitter_distrib_file);
 
@@ -1488,6 +1734,9 @@ int getConfigs(void){
 
 		strcpy(f.old_log_file, sp);
 		strcat(f.old_log_file, old_log_file);
+
+		strcpy(f.journal_file, sp);
+		strcat(f.journal_file, journal_file);
 	}
 
 	sp = getString(PPSDEVICE);
@@ -1502,11 +1751,7 @@ int getConfigs(void){
 		strcpy(f.pps_device, sp);
 	}
 
-	sp = getString(PPSDELAY);
-	if (sp != NULL){
-		char *ptr;
-		g.zeroOffset = (int)strtol(sp, &ptr, 10);
-	}
+	getInt(PPSDELAY, &g.zeroOffset);
 
 	sp = getString(SEGREGATE);
 	if (sp != NULL){
@@ -1517,10 +1762,7 @@ int getConfigs(void){
 		}
 	}
 
-	sp = getString(PPSPHASE);
-	if (sp != NULL){
-		char *ptr;
-		g.ppsPhase = (int)strtol(sp, &ptr, 10);
+	if (getInt(PPSPHASE, &g.ppsPhase)){
 		if(g.ppsPhase > 1){
 			printf("Invalid value for ppsphase in pps-client.conf. Must be 0 or 1.\n");
 			return -1;
@@ -1569,178 +1811,234 @@ int getConfigs(void){
 		g.exitOnLostPPS = false;
 	}
 
+	int logSize = LOG_SIZE_DEFAULT;
+	int logGenerations = LOG_GENERATIONS_DEFAULT;
+	if (getInt(LOG_SIZE, &logSize) && logSize < LOG_SIZE_MIN){
+		printf("Invalid value for log-size in pps-client.conf. Must be at least %d.\n", LOG_SIZE_MIN);
+		return -1;
+	}
+	if (getInt(LOG_GENERATIONS, &logGenerations)
+			&& (logGenerations < 1 || logGenerations > LOG_GENERATIONS_MAX)){
+		printf("Invalid value for log-generations in pps-client.conf. Must be 1 to %d.\n", LOG_GENERATIONS_MAX);
+		return -1;
+	}
+	setLogRotation(logSize, logGenerations);
+
 	return 0;
 }
 
 /**
- * Write a timestamp provided as a double to a temporary
- * file each second.
- *
- * @param[in] timestamp The timestamp value.
+ * The date and time to the minute of the last status
+ * line formatted by formatStatusParams(), which changes
+ * only once a minute.
  */
-void writeTimestamp(double timestamp){
-	memset(g.strbuf, 0, STRBUF_SZ-1);
+static struct statusFormatVars {
+	int64_t minute;										// pps_sec / 60 of timeStr
+	char timeStr[17];									// "YYYY-MM-DD HH:MM" in local time
+} sf = {-1, {0}};
 
-	sprintf(g.strbuf, "%lf#%d\n", timestamp, g.seq_num);
-	remove(f.assert_file);
-
-	int pfd = open_logerr(f.assert_file, O_CREAT | O_WRONLY, "writeTimestamp() 1");
-	if (pfd == -1){
-		return;
-	}
-	int rv = write(pfd, g.strbuf, strlen(g.strbuf) + 1);		// Write PPS timestamp to f.assert_file
-	if (rv == -1){
-		sprintf(g.logbuf, "writeTimestamp() write to assert_file failed with error: %s\n", strerror(errno));
-		writeToLog(g.logbuf, "writeTimestamp() 2");
+/**
+ * Writes v to buf as exactly \b digits decimal digits
+ * with leading zeros.
+ */
+static void putDigits(char *buf, unsigned int v, int digits){
+	for (int i = digits - 1; i >= 0; i--){
+		buf[i] = '0' + v % 10;
+		v /= 10;
 	}
-	close(pfd);
 }
 
 /**
- * Provides formatting for console printf() strings.
- *
- * Horizontally left-aligns a number following token, ignoring
- * numeric sign, in a buffer generated by sprintf() by padding
- * the buffer with spaces preceding the number to be aligned and
- * returning the adjusted length of the buffer.
- *
- * @param[in] token The token string preceding the number to be aligned.
- * @param[in,out] buf The buffer containing the token.
- * @param[in] len The initial length of the buffer.
+ * Writes v to buf in decimal.
  *
- * @returns Adjusted length of the buffer.
+ * @returns The number of characters written.
  */
-int alignNumbersAfter(const char *token, char *buf, int len){
-	int pos = 0;
+static int putUnsigned(char *buf, uint64_t v){
+	char tmp[20];
+	int n = 0;
 
-	char *str = strstr(buf, token);
-	if (str == NULL){
-		sprintf(g.logbuf, "alignNumbersAfter(): token not found. Exiting.\n");
-		writeToLog(g.logbuf, "alignNumbersAfter()");
-		return -1;
-	}
-	str += strlen(token);
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v != 0);
 
-	pos = str - buf;
-	if (buf[pos] != '-'){
-		memmove(str + 1, str, len - pos);
-		buf[pos] = ' ';
-		len += 1;
+	for (int i = 0; i < n; i++){
+		buf[i] = tmp[n - 1 - i];
 	}
-	return len;
+	return n;
 }
 
 /**
- * Provides formatting for console printf() strings.
+ * Writes the magnitude of v to buf with six decimal
+ * places as printf() "%f" would, which takes at most
+ * 316 characters.
  *
- * Horizontally aligns token by a fixed number of
- * characters from the end of refToken by padding
- * the buffer with spaces at the end of the number
- * following refToken.
- *
- * @param[in] refToken The reference token which
- * is followed by a number having a variable length.
- *
- * @param[in] offset The number of characters in the
- * adjusted buffer from the end of refToken to the start
- * of token.
- *
- * @param[in] token The token to be aligned.
- * @param[out] buf The buffer containing the tokens.
- * @param[in] len the initial length of the buffer.
- *
- * @returns The adjusted length of the buffer.
+ * @returns The number of characters written.
  */
-int alignTokens(const char *refToken, int offset, const char *token, char *buf, int len){
+static int putFixed6(char *buf, double v){
+	double mag = fabs(v);
 
-	int pos1, pos2;
-
-	char *str = strstr(buf, refToken);
-	if (str == NULL){
-		sprintf(g.logbuf, "alignTokens(): refToken not found. Exiting.\n");
-		writeToLog(g.logbuf, "alignTokens()");
-		return -1;
+	if (isnan(mag)){
+		memcpy(buf, "nan", 3);
+		return 3;
 	}
-	str += strlen(refToken);
-	pos1 = str - buf;
-
-	str = strstr(buf, token);
-	if (str == NULL){
-		sprintf(g.logbuf, "alignTokens(): token not found. Exiting.\n");
-		writeToLog(g.logbuf, "alignTokens()");
-		return -1;
+	if (isinf(mag)){
+		memcpy(buf, "inf", 3);
+		return 3;
+	}
+	if (mag >= 1e12){									// Too large for llrint() in microseconds
+		return sprintf(buf, "%.6f", mag);
 	}
-	pos2 = str - buf;
 
-	while (pos2 < pos1 + offset){
-		memmove(str + 1, str, len - pos2);
-		buf[pos2] = ' ';
-		pos2 += 1;
-		str += 1;
-		len += 1;
+	uint64_t micro = (uint64_t)llrint(mag * 1e6);
+	double r = fma(mag, 1e6, -(double)micro);			// The exact remainder of the rounding
+	if (r > 0.5 || (r == 0.5 && (micro & 1))){			// Rounds half to even as "%f" does
+		micro += 1;
+	}
+	else if (r < -0.5 || (r == -0.5 && (micro & 1))){
+		micro -= 1;
 	}
+
+	int n = putUnsigned(buf, micro / 1000000);
+	buf[n++] = '.';
+	putDigits(buf + n, (unsigned int)(micro % 1000000), 6);
+	return n + 6;
+}
+
+/**
+ * Writes text to buf.
+ *
+ * @returns The number of characters written.
+ */
+static int putText(char *buf, const char *text, int len){
+	memcpy(buf, text, len);
 	return len;
 }
 
 /**
- * Records a state params string to a buffer, savebuf, that
- * is saved to a tmpfs memory file by writeStatusStrings()
- * along with other relevant messages recorded during the
- * same second.
+ * Pads buf with spaces from pos up to col.
+ *
+ * @returns The larger of pos and col.
+ */
+static int padTo(char *buf, int pos, int col){
+	while (pos < col){
+		buf[pos++] = ' ';
+	}
+	return pos;
+}
+
+/**
+ * Formats the state params as the status line
+ * shown by the status display.
+ *
+ * Each field is converted in place at its column. The
+ * numbers after "jitter:" and "avgCorrection:" have a
+ * column for the sign so that their digits align, and
+ * "freqOffset:", "avgCorrection:" and "clamp:" start 6,
+ * 12 and 12 characters after the end of the label before
+ * them unless the number between is too long.
+ *
+ * @param[in] p The state params.
+ * @param[out] printStr The status line. At least
+ * STATUS_LINE_SZ characters long. Lines are usually
+ * about 120 characters but each of the two floating
+ * point numbers can take up to 316.
+ *
+ * @returns The length of the status line.
+ */
+int formatStatusParams(const struct ppsStatusParams *p, char *printStr){
+	char *buf = printStr;
+	int n;
+
+	int64_t minute = p->pps_sec / SECS_PER_MINUTE;
+	if (minute != sf.minute){
+		struct tm tmp;
+		time_t t = (time_t)p->pps_sec;
+		localtime_r(&t, &tmp);
+
+		putDigits(sf.timeStr, tmp.tm_year + 1900, 4);
+		sf.timeStr[4] = '-';
+		putDigits(sf.timeStr + 5, tmp.tm_mon + 1, 2);
+		sf.timeStr[7] = '-';
+		putDigits(sf.timeStr + 8, tmp.tm_mday, 2);
+		sf.timeStr[10] = ' ';
+		putDigits(sf.timeStr + 11, tmp.tm_hour, 2);
+		sf.timeStr[13] = ':';
+		putDigits(sf.timeStr + 14, tmp.tm_min, 2);
+		sf.minute = minute;
+	}
+
+	n = putText(buf, sf.timeStr, 16);
+	buf[n++] = ':';
+	putDigits(buf + n, (unsigned int)(p->pps_sec - minute * SECS_PER_MINUTE), 2);
+	n += 2;
+	buf[n++] = '.';
+	putDigits(buf + n, (unsigned int)p->pps_usec, 6);
+	n += 6;
+
+	n += putText(buf + n, "  ", 2);
+	n += putUnsigned(buf + n, p->seq_num);
+
+	n += putText(buf + n, "  jitter:", 9);
+	int col = n;
+	buf[n++] = ' ';
+	buf[n++] = (p->jitter < 0) ? '-' : ' ';
+	n += putUnsigned(buf + n, (uint64_t)llabs(p->jitter));
+	buf[n++] = ' ';
+	n = padTo(buf, n, col + 6);
+
+	n += putText(buf + n, "freqOffset:", 11);
+	col = n;
+	n += putText(buf + n, "  ", 2);
+	if (signbit(p->freqOffset)){
+		buf[n++] = '-';
+	}
+	n += putFixed6(buf + n, p->freqOffset);
+	buf[n++] = ' ';
+	n = padTo(buf, n, col + 12);
+
+	n += putText(buf + n, "avgCorrection:", 14);
+	col = n;
+	buf[n++] = ' ';
+	buf[n++] = signbit(p->avgCorrection) ? '-' : ' ';
+	n += putFixed6(buf + n, p->avgCorrection);
+	n += putText(buf + n, "  ", 2);
+	n = padTo(buf, n, col + 12);
+
+	n += putText(buf + n, "clamp: ", 7);
+	if (p->hardLimit < 0){
+		buf[n++] = '-';
+	}
+	n += putUnsigned(buf + n, (uint64_t)llabs(p->hardLimit));
+	if (! p->clampAbsolute){
+		buf[n++] = '*';
+	}
+	buf[n++] = '\n';
+	buf[n] = '\0';
+
+	return n;
+}
+
+/**
+ * Marks the state params of this second for publication
+ * to the status block by writeStatusStrings() along with
+ * other relevant messages recorded during the same second.
  *
  * @returns 0 on success, else -1 on error.
  */
 int bufferStateParams(void){
 
 	if (g.interruptLossCount == 0) {
-		const char *timefmt = "%F %H:%M:%S";
-		char timeStr[50];
-		char printStr[200];
-
-		memset(timeStr, 0, 50 * sizeof(char));
-		strftime(timeStr, 50, timefmt, localtime(&g.pps_t_sec));
-
-		char *printfmt = g.strbuf;
-
-		strcpy(printfmt, "%s.%06d  %d  jitter: ");
-
-		if (g.clampAbsolute){
-			strcat(printfmt, "%d freqOffset: %f avgCorrection: %f  clamp: %d\n");
-		}
-		else {
-			strcat(printfmt, "%d freqOffset: %f avgCorrection: %f  clamp: %d*\n");
-		}
+		g.hasStatusLine = true;
 
-		sprintf(printStr, printfmt, timeStr, g.pps_t_usec, g.seq_num,
-				g.jitter, g.freqOffset, g.avgCorrection, g.hardLimit);
+		if (g.isVerbose){
+			struct ppsStatusParams p;
+			char printStr[STATUS_LINE_SZ];
 
-		int len = strlen(printStr) + 1;							// strlen + '\0'
-		len = alignNumbersAfter("jitter: ", printStr, len);
-		if (len == -1){
-			return -1;
-		}
-		len = alignTokens("jitter:", 6, "freqOffset:", printStr, len);
-		if (len == -1){
-			return -1;
-		}
-		len = alignNumbersAfter("freqOffset:", printStr, len);
-		if (len == -1){
-			return -1;
-		}
-		len = alignTokens("freqOffset:", 12, "avgCorrection:", printStr, len);
-		if (len == -1){
-			return -1;
+			getStatusParams(&p);
+			int len = formatStatusParams(&p, printStr);
+			fwrite(printStr, 1, len, stdout);
 		}
-		len = alignNumbersAfter("avgCorrection: ", printStr, len);
-		if (len == -1){
-			return -1;
-		}
-		len = alignTokens("avgCorrection:", 12, "clamp:", printStr, len);
-		if (len == -1){
-			return -1;
-		}
-
-		bufferStatusMsg(printStr);
 	}
 	return 0;
 }
@@ -1974,39 +2272,60 @@ int assignProcessorAffinity(void){
 
 
 /**
- * Extracts the sequence number G.seq_num from a char string
- * and returns the value.
+ * Maps the status block published by the PPS-Client
+ * daemon for reading. The block is mapped writable if
+ * permitted so that ppsWaitForUpdate() can count this
+ * reader as a waiter, else read-only.
  *
- * @param[in] pbuf The string to search.
+ * @param[out] waiters The waiter count of the status
+ * block or NULL if the block is mapped read-only.
  *
- * @returns The sequence number.
+ * @returns A pointer to the status block or NULL
+ * if the status block is not available.
  */
-int getSeqNum(const char *pbuf){
-
-	char *pSpc, *pNum;
-	int seqNum = 0;
+const struct ppsStatus *mapStatusShm(uint32_t **waiters){
+	struct stat stat_buf;
+	int prot = PROT_READ | PROT_WRITE;
 
-	pSpc = strpbrk((char *)pbuf, space);
+	int fd = open(f.status_file, O_RDWR);
+	if (fd == -1){
+		prot = PROT_READ;
+		fd = open(f.status_file, O_RDONLY);
+	}
+	if (fd == -1){
+		return NULL;
+	}
 
-	pNum = strpbrk(pSpc, num);
-	pSpc = strpbrk(pNum, space);
-	pNum = strpbrk(pSpc, num);
+	if (fstat(fd, &stat_buf) == -1 || stat_buf.st_size < (off_t)sizeof(struct ppsStatus)){
+		close(fd);
+		return NULL;
+	}
 
-	sscanf(pNum, "%d ", &seqNum);
-	return seqNum;
+	void *p = mmap(NULL, sizeof(struct ppsStatus), prot, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED){
+		return NULL;
+	}
+	*waiters = (prot & PROT_WRITE) ? &((struct ppsStatus *)p)->waiters : NULL;
+	return (const struct ppsStatus *)p;
 }
 
 /**
- * Reads the state params saved to shared memory by the
- * PPS-Client daemon and prints the param string to the
- * console each second.
+ * Reads the state params and status messages published
+ * to the shared memory status block by the PPS-Client
+ * daemon and prints them to the console each time the
+ * daemon publishes a new PPS sample.
  */
 void showStatusEachSecond(void){
-	struct timeval tv1;
-	struct timespec ts2;
-	char paramsBuf[MSGBUF_SZ];
-	struct stat stat_buf;
-	int seqNum = 0, lastSeqNum = -1;
+	char printStr[STATUS_LINE_SZ];
+	const struct ppsStatus *shm = NULL;
+	uint32_t *waiters = NULL;
+	struct ppsStatus *st = new struct ppsStatus;
+	struct timespec timeout = {2, 0};						// Longer than one PPS interval
+	struct timespec retry = {1, 0};
+	unsigned int lastSeqNum = 0, lastMsgCount = 0;
+	uint32_t lastGeneration = 0;
+	bool isFirst = true;
 
 	if (g.doSerialsettime == true){
 		printf("\nSerial port, %s, is providing time of day from GPS Satellites\n\n", g.serialPort);
@@ -2015,69 +2334,56 @@ void showStatusEachSecond(void){
 		printf("\nNIST UDP time servers are providing time of day over the Internet\n\n");
 	}
 
-	int dispTime = 500000;									// Display at half second
-
-	gettimeofday(&tv1, NULL);
-	ts2 = setSyncDelay(dispTime, tv1.tv_usec);
-
 	for (;;){
 
 		if (g.exit_loop){
 			break;
 		}
-		nanosleep(&ts2, NULL);
-
-		int fd = open(f.displayParams_file, O_RDONLY);
-		if (fd == -1){
-			printf("showStatusEachSecond(): Could not open f.displayParams_file");
-			printf("%s", f.displayParams_file);
-			printf("\n");
-		}
-		else {
-			fstat(fd, &stat_buf);
-			int sz = stat_buf.st_size;
-
-			if (sz >= MSGBUF_SZ){
-				printf("showStatusEachSecond() buffer too small. sz: %d\n", sz);
-				close(fd);
-				break;
-			}
-
-			int rv = read(fd, paramsBuf, sz);
-			close(fd);
-			if (rv == -1){
-				printf("showStatusEachSecond() Read paramsBuf failed with error: %s\n", strerror(errno));
-				break;
 
+		if (shm == NULL){
+			shm = mapStatusShm(&waiters);
+			if (shm == NULL){
+				printf("showStatusEachSecond(): Could not read %s\n", f.status_file);
+				nanosleep(&retry, NULL);
+				continue;
 			}
+		}
 
-			if (sz > 0){
-
-				paramsBuf[sz]= '\0';
-
-				char *sv = strstr(paramsBuf, "jitter");
-				if (sv != NULL){								// Is a standard status line containing "jitter".
-					seqNum = getSeqNum(paramsBuf);
+		if (! isFirst && ppsWaitForUpdate(&shm->generation, waiters, lastGeneration, &timeout) == -1){
+			continue;										// Timeout or ctrl-c
+		}
 
-					if (seqNum != lastSeqNum){
-						printf("%s", paramsBuf);
-					}
-				}
-				else {											// Is informational or error message
-					seqNum += 1;
+		if (ppsReadStatus(shm, st) == -1){
+			printf("showStatusEachSecond(): Could not read %s\n", f.status_file);
+			nanosleep(&retry, NULL);
+			continue;
+		}
+		lastGeneration = st->generation;
 
-					if (seqNum != lastSeqNum){
-						printf("%s", paramsBuf);
-					}
-				}
-				lastSeqNum = seqNum;
-			}
+		if (isFirst || st->msgCount < lastMsgCount){			// Show only new messages on start or restart
+			lastMsgCount = st->msgCount;
+			isFirst = false;
+		}
+		if (st->msgCount - lastMsgCount > PPS_MSG_RING_LEN){
+			lastMsgCount = st->msgCount - PPS_MSG_RING_LEN;
+		}
+		while (lastMsgCount != st->msgCount){					// Informational or error messages
+			printf("%s", st->msgs[lastMsgCount % PPS_MSG_RING_LEN]);
+			lastMsgCount += 1;
 		}
 
-		gettimeofday(&tv1, NULL);
+		if ((st->params.status & PPS_STATUS_PARAMS_VALID) && st->params.seq_num != lastSeqNum){
+			int len = formatStatusParams(&st->params, printStr);
+			fwrite(printStr, 1, len, stdout);
+			lastSeqNum = st->params.seq_num;
+		}
+		fflush(stdout);
+	}
 
-		ts2 = setSyncDelay(dispTime, tv1.tv_usec);
+	if (shm != NULL){
+		munmap((void *)shm, sizeof(struct ppsStatus));
 	}
+	delete st;
 	printf(" Exiting PPS-Client status display\n");
 }
 
@@ -2112,38 +2418,83 @@ bool missingArg(int argc, char *argv[], int i){
 }
 
 /**
- * Transmits a data save request to the PPS-Client daemon via
- * data written to a tmpfs shared memory file.
+ * Sends a data request to the PPS-Client daemon over the
+ * control socket and writes the data that is returned to
+ * a file or, for a streaming request without a file, to
+ * the terminal until ctrl-c.
  *
  * @param[in] requestStr The request string.
- * @param[in] filename The shared memory file to write to.
+ * @param[in] filename The file to write to or NULL to
+ * write to stdout.
  *
  * @returns 0 on success, else -1 on error.
  */
 int daemonSaveArray(const char *requestStr, const char *filename){
-	char buf[200];
+	struct sockaddr_un addr;
+	char buf[CTL_PACKET_SZ + 1];
 
-	int fd = open_logerr(f.arrayData_file, O_CREAT | O_WRONLY | O_TRUNC, "daemonSaveArray()");
-	if (fd == -1){
-		printf("daemonSaveArray() Open f.arrayData_file failed\n");
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, f.control_socket, sizeof(addr.sun_path) - 1);
+
+	int sfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (sfd == -1){
+		printf("daemonSaveArray() Could not create socket: %s\n", strerror(errno));
+		return -1;
+	}
+	if (connect(sfd, (struct sockaddr *)&addr, sizeof(addr)) == -1){
+		printf("daemonSaveArray() Could not connect to %s: %s\n", f.control_socket, strerror(errno));
+		close(sfd);
+		return -1;
+	}
+
+	if (send(sfd, requestStr, strlen(requestStr), 0) == -1){
+		printf("daemonSaveArray() Could not send request: %s\n", strerror(errno));
+		close(sfd);
 		return -1;
 	}
 
-	strcpy(buf, requestStr);
+	int n = recv(sfd, buf, CTL_PACKET_SZ, 0);
+	if (n <= 0){
+		printf("daemonSaveArray() No reply from PPS-Client\n");
+		close(sfd);
+		return -1;
+	}
+	buf[n] = '\0';
+	if (strncmp(buf, "OK", 2) != 0){
+		printf("%s", buf);
+		close(sfd);
+		return -1;
+	}
 
+	int fd = STDOUT_FILENO;
 	if (filename != NULL){
-		strcat(buf, " ");
-		strcat(buf, filename);
+		fd = open(filename, O_CREAT | O_WRONLY | O_TRUNC, S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH);
+		if (fd == -1){
+			printf("daemonSaveArray() Could not open %s: %s\n", filename, strerror(errno));
+			close(sfd);
+			return -1;
+		}
 	}
 
-	int rv = write(fd, buf, strlen(buf) + 1);
-	close(fd);
-	if (rv == -1){
-		sprintf(g.logbuf, "daemonSaveArray() Write to tmpfs memory file failed\n");
-		writeToLog(g.logbuf, "daemonSaveArray()");
-		return -1;
+	int rv = 0;
+	while (! g.exit_loop){
+		n = recv(sfd, buf, CTL_PACKET_SZ, 0);
+		if (n <= 0){										// Daemon closed the connection.
+			break;
+		}
+		if (write(fd, buf, n) == -1){
+			printf("daemonSaveArray() Write to %s failed: %s\n", filename, strerror(errno));
+			rv = -1;
+			break;
+		}
 	}
-	return 0;
+
+	if (fd != STDOUT_FILENO){
+		close(fd);
+	}
+	close(sfd);
+	return rv;
 }
 
 /**
@@ -2185,7 +2536,7 @@ int parseSaveDataRequest(int argc, char *argv[], const char *requestStr){
 		return -1;
 	}
 
-	char *filename = NULL;
+	const char *filename = NULL;
 	for (int j = 1; j < argc; j++){
 		if (strcmp(argv[j], "-f") == 0){
 			if (missingArg(argc, argv, j)){
@@ -2202,12 +2553,12 @@ int parseSaveDataRequest(int argc, char *argv[], const char *requestStr){
 	if (filename != NULL){
 		printf("Writing to file: %s\n", filename);
 	}
+	else if (arrayData[i].filename != NULL){
+		filename = arrayData[i].filename;
+		printf("Writing to default file: %s\n", filename);
+	}
 	else {
-		for (i = 0; i < arrayLen; i++){
-			if (strcmp(requestStr, arrayData[i].label) == 0){
-				printf("Writing to default file: %s\n", arrayData[i].filename);
-			}
-		}
+		printf("Streaming %s (ctrl-c to quit):\n", requestStr);
 	}
 
 	if (daemonSaveArray(requestStr, filename) == -1){
@@ -2336,9 +2687,7 @@ void buildJitterDistrib(int rawError){
  */
 void TERMhandler(int sig){
 	signal(SIGTERM, SIG_IGN);
-	sprintf(g.logbuf,"Recieved SIGTERM\n");
-	writeToLog(g.logbuf, "TERMhandler()");
-	g.exit_requested = true;
+	g.exit_requested = true;					// Logged by waitForPPS()
 	signal(SIGTERM, TERMhandler);
 }
 
@@ -2387,6 +2736,10 @@ void recordFrequencyVars(void){
 
 		g.freqOffsetRec[g.recIndex] = g.freqOffsetSum * norm;
 
+		if (g.hardLimit <= HARD_LIMIT_4){					// Only offsets of a settled controller
+			recordDrift(g.t.tv_sec, g.freqOffsetRec[g.recIndex]);	// go into the drift model.
+		}
+
 		g.recIndex += 1;
 		if (g.recIndex == NUM_5_MIN_INTERVALS){
 			g.recIndex = 0;
@@ -2404,7 +2757,8 @@ void recordFrequencyVars(void){
  * clock.
  *
  * These values are recorded so that they may be saved to disk
- * for analysis.
+ * for analysis. The last 10 minutes are kept in G and the long
+ * term history in the history store.
  *
  * @param[in] timeCorrection The time correction value to be
  * recorded.
@@ -2419,6 +2773,8 @@ void recordOffsets(int timeCorrection){
 	if (g.recIndex2 >= SECS_PER_10_MIN){
 		g.recIndex2 = 0;
 	}
+
+	recordHistory(g.t.tv_sec, (double)timeCorrection, g.freqOffset);
 }
 
 /**
@@ -2498,11 +2854,11 @@ int find_source(const char *path, pps_handle_t *handle, int *avail_mode)
  *
  * @param[in] handle The handle to the system PPS driver.
  * @param[in] avail_mode Info for the driver.
- * @param[out] tm The timestamp obtained from the driver.
+ * @param[out] ts The timestamp obtained from the driver.
  *
  * @returns 0 on success, else -1 on driver error.
  */
-int readPPSTimestamp(pps_handle_t *handle, int *avail_mode, int *tm)
+int readPPSTimestamp(pps_handle_t *handle, int *avail_mode, struct timespec *ts)
 {
 	struct timespec timeout;
 	pps_info_t infobuf;
@@ -2531,12 +2887,10 @@ retry:
 	}
 
 	if (g.ppsPhase == 0){
-		tm[0] = (int)infobuf.assert_timestamp.tv_sec;
-		tm[1] = (int)(infobuf.assert_timestamp.tv_nsec / 1000);
+		*ts = infobuf.assert_timestamp;
 	}
 	else {
-		tm[0] = (int)infobuf.clear_timestamp.tv_sec;
-		tm[1] = (int)(infobuf.clear_timestamp.tv_nsec / 1000);
+		*ts = infobuf.clear_timestamp;
 	}
 
 	return 0;
@@ -2582,6 +2936,9 @@ int getRootHome(void){
 	strcpy(f.integral_state_file, pbuf);
 	strcat(f.integral_state_file, integral_state_file);
 
+	strcpy(f.drift_file, pbuf);
+	strcat(f.drift_file, drift_file);
+
 	remove(f.home_file);
 
 	return 0;
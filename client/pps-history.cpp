@@ -0,0 +1,268 @@
+/**
+ * @file pps-history.cpp
+ * @brief This file contains the round-robin store of the time
+ * corrections and frequency offsets of the controller.
+ *
+ * The store holds the history at four resolutions, each in a ring
+ * that overwrites its oldest point when full:
+ *
+ * - 1 second points for the last hour
+ * - 10 second points for the last day
+ * - 5 minute points for the last 30 days
+ * - 1 hour points for the last year
+ *
+ * Each point holds the mean, minimum and maximum time correction
+ * and the mean frequency offset over its interval. Every tier
+ * accumulates the point for its current interval in place as each
+ * second is recorded and appends it to its ring when the interval
+ * ends, so recording a second costs the same fixed work whatever
+ * the resolution.
+ *
+ * The store is a memory-mapped file, by default
+ * /var/local/pps-history, that includes the points being
+ * accumulated, so the history continues across restarts of the
+ * daemon. The file is written back by the kernel; it is synced
+ * when the daemon exits. A store into a page of the file can
+ * block while the kernel writes the page back, so the controller
+ * thread passes each second to the writer thread, which does all
+ * of the stores into the mapping. "pps-client -s pps-history" writes
+ * the store as text.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+
+extern struct G g;
+extern struct ppsFiles f;
+
+/**
+ * The interval and ring length of each tier.
+ */
+static const int tierStep[HISTORY_TIERS] = {1, 10, SECS_PER_5_MIN, SECS_PER_HOUR};
+static const int tierLen[HISTORY_TIERS] = {HISTORY_LEN_1S, HISTORY_LEN_10S, HISTORY_LEN_5MIN, HISTORY_LEN_1H};
+
+/**
+ * Local file-scope shared variables.
+ */
+static struct historyLocalVars {
+	struct historyFile *h;
+} hs = {NULL};
+
+/**
+ * Clears the store and lays out the tiers.
+ */
+static void resetHistory(struct historyFile *h){
+	int first = 0;
+
+	memset(h, 0, sizeof(struct historyFile));
+	h->version = HISTORY_VERSION;
+
+	for (int i = 0; i < HISTORY_TIERS; i++){
+		h->tier[i].step = tierStep[i];
+		h->tier[i].len = tierLen[i];
+		h->tier[i].first = first;
+		first += tierLen[i];
+	}
+	h->magic = HISTORY_MAGIC;
+}
+
+/**
+ * Maps the history file, creating it if necessary. A file
+ * of another size or version is replaced by an empty store.
+ *
+ * @returns 0 on success or if no history file is
+ * configured, else -1 on error.
+ */
+int initHistory(void){
+	struct stat st;
+	mode_t mode = S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH;
+
+	if (hs.h != NULL || f.history_file[0] == '\0'){
+		return 0;
+	}
+
+	int fd = open(f.history_file, O_CREAT | O_RDWR, mode);
+	if (fd == -1){
+		couldNotOpenMsgTo(g.logbuf, f.history_file, "initHistory()");
+		writeToLog(g.logbuf, "initHistory()");
+		return -1;
+	}
+
+	bool isValid = (fstat(fd, &st) == 0 && st.st_size == sizeof(struct historyFile));
+
+	if (! isValid && ftruncate(fd, sizeof(struct historyFile)) == -1){
+		sprintf(g.logbuf, "initHistory() Could not size %s. Error: %s\n", f.history_file, strerror(errno));
+		writeToLog(g.logbuf, "initHistory()");
+		close(fd);
+		return -1;
+	}
+
+	void *p = mmap(NULL, sizeof(struct historyFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);											// The mapping holds the file open.
+	if (p == MAP_FAILED){
+		sprintf(g.logbuf, "initHistory() Could not map %s. Error: %s\n", f.history_file, strerror(errno));
+		writeToLog(g.logbuf, "initHistory()");
+		return -1;
+	}
+	hs.h = (struct historyFile *)p;
+
+	if (! isValid || hs.h->magic != HISTORY_MAGIC || hs.h->version != HISTORY_VERSION){
+		resetHistory(hs.h);
+	}
+	return 0;
+}
+
+/**
+ * Syncs and unmaps the history file. Called after
+ * the writer thread has stopped.
+ */
+void freeHistory(void){
+	if (hs.h == NULL){
+		return;
+	}
+	msync(hs.h, sizeof(struct historyFile), MS_SYNC);
+	munmap(hs.h, sizeof(struct historyFile));
+	hs.h = NULL;
+}
+
+/**
+ * Adds the values of one second to the point being
+ * accumulated by a tier, first appending that point
+ * to the ring if the second is in a new interval.
+ */
+static void addToTier(struct historyFile *h, struct historyTier *tr, int64_t t, float offset, double freqOffset){
+	struct historyPoint *acc = &tr->acc;
+	int64_t start = t - t % tr->step;
+
+	if (acc->count > 0 && acc->t != start){
+		h->points[tr->first + tr->head] = *acc;
+		tr->head = (tr->head + 1) % tr->len;
+		if (tr->filled < (uint32_t)tr->len){
+			tr->filled += 1;
+		}
+		acc->count = 0;
+	}
+
+	if (acc->count == 0){
+		acc->t = start;
+		acc->offsetMean = offset;
+		acc->offsetMin = offset;
+		acc->offsetMax = offset;
+		acc->freqOffset = freqOffset;
+		acc->count = 1;
+		return;
+	}
+
+	acc->count += 1;
+	acc->offsetMean += (offset - acc->offsetMean) / acc->count;		// Running means
+	acc->freqOffset += (freqOffset - acc->freqOffset) / acc->count;
+	if (offset < acc->offsetMin){
+		acc->offsetMin = offset;
+	}
+	if (offset > acc->offsetMax){
+		acc->offsetMax = offset;
+	}
+}
+
+/**
+ * Records the time correction and frequency offset of
+ * one second in every tier of the store. Called by the
+ * writer thread or, if it is not running, by recordHistory().
+ *
+ * @param[in] t The second of the PPS.
+ * @param[in] timeCorrection The time correction in microseconds.
+ * @param[in] freqOffset The frequency offset in ppm.
+ */
+void addHistorySample(int64_t t, double timeCorrection, double freqOffset){
+	struct historyFile *h = hs.h;
+
+	if (h == NULL){
+		return;
+	}
+	for (int i = 0; i < HISTORY_TIERS; i++){
+		addToTier(h, &h->tier[i], t, (float)timeCorrection, freqOffset);
+	}
+}
+
+/**
+ * Passes the time correction and frequency offset of
+ * one second to the writer thread to be recorded in
+ * the store. The second is dropped if the writer queue
+ * is full. Called by the controller thread.
+ *
+ * @param[in] t The second of the PPS.
+ * @param[in] timeCorrection The time correction in microseconds.
+ * @param[in] freqOffset The frequency offset in ppm.
+ */
+void recordHistory(int64_t t, double timeCorrection, double freqOffset){
+	if (hs.h == NULL){
+		return;
+	}
+	if (queueHistory(t, timeCorrection, freqOffset) == -1){
+		addHistorySample(t, timeCorrection, freqOffset);
+	}
+}
+
+/**
+ * Writes the points of every tier, oldest first, as lines of
+ * the tier interval in seconds, the start time of the point,
+ * the seconds recorded in it, the mean, minimum and maximum
+ * time correction in microseconds and the mean frequency
+ * offset in ppm. The points being accumulated are not written.
+ *
+ * @param[in] fd The file or socket to write to.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int writeHistoryTo(int fd){
+	char buf[CTL_PACKET_SZ];
+	char line[MAX_LINE_LEN * 2];
+	int len = 0;
+	const struct historyFile *h = hs.h;
+
+	if (h == NULL){
+		return 0;
+	}
+
+	for (int i = 0; i < HISTORY_TIERS; i++){
+		const struct historyTier *tr = &h->tier[i];
+		int n = tr->filled;
+		int start = (n < tr->len) ? 0 : tr->head;
+
+		for (int j = 0; j < n; j++){
+			const struct historyPoint *p = &h->points[tr->first + (start + j) % tr->len];
+			int lineLen = snprintf(line, sizeof(line), "%d %lld %u %.3f %.3f %.3f %.4lf\n", tr->step,
+					(long long)p->t, p->count, p->offsetMean, p->offsetMin, p->offsetMax, p->freqOffset);
+
+			if (len + lineLen > CTL_PACKET_SZ){
+				if (write(fd, buf, len) == -1){
+					return -1;
+				}
+				len = 0;
+			}
+			memcpy(buf + len, line, lineLen);
+			len += lineLen;
+		}
+	}
+	if (len > 0 && write(fd, buf, len) == -1){
+		return -1;
+	}
+	return 0;
+}
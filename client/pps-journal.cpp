@@ -0,0 +1,182 @@
+/**
+ * @file pps-journal.cpp
+ * @brief This file contains the event journal of the controller.
+ *
+ * The state transitions of the controller that are also written
+ * to the log file as text are recorded as fixed-size binary records
+ * in the ring of a memory-mapped file, by default /var/log/pps-journal,
+ * whose layout is in pps-journal.h. The controller thread reads the
+ * clocks for the record of an event and passes the record to the writer
+ * thread, which copies it into the mapping, because a store into a
+ * page of the file can block while the kernel writes the page back.
+ * The file is written back by the kernel; it is synced when the daemon
+ * exits.
+ * The pps-journal utility filters and exports the journal.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+
+extern struct G g;
+extern struct ppsFiles f;
+extern struct clockBackend *clk;
+
+/**
+ * Local file-scope shared variables.
+ */
+static struct journalLocalVars {
+	struct ppsJournal *j;
+} jl = {NULL};
+
+/**
+ * Clears the journal.
+ */
+static void resetJournal(struct ppsJournal *j){
+	memset(j, 0, sizeof(struct ppsJournal));
+	j->version = PPS_JOURNAL_VERSION;
+	j->recordSize = sizeof(struct ppsJournalRecord);
+	j->len = PPS_JOURNAL_LEN;
+	__atomic_store_n(&j->magic, PPS_JOURNAL_MAGIC, __ATOMIC_RELEASE);
+}
+
+/**
+ * Maps the journal file, creating it if necessary. A file
+ * of another size or layout is replaced by an empty journal.
+ *
+ * @returns 0 on success or if no journal file is
+ * configured, else -1 on error.
+ */
+int initJournal(void){
+	struct stat st;
+	mode_t mode = S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH;
+
+	if (jl.j != NULL || f.journal_file[0] == '\0'){
+		return 0;
+	}
+
+	int fd = open(f.journal_file, O_CREAT | O_RDWR, mode);
+	if (fd == -1){
+		couldNotOpenMsgTo(g.logbuf, f.journal_file, "initJournal()");
+		writeToLog(g.logbuf, "initJournal()");
+		return -1;
+	}
+
+	bool isValid = (fstat(fd, &st) == 0 && st.st_size == sizeof(struct ppsJournal));
+
+	if (! isValid && ftruncate(fd, sizeof(struct ppsJournal)) == -1){
+		sprintf(g.logbuf, "initJournal() Could not size %s. Error: %s\n", f.journal_file, strerror(errno));
+		writeToLog(g.logbuf, "initJournal()");
+		close(fd);
+		return -1;
+	}
+
+	void *p = mmap(NULL, sizeof(struct ppsJournal), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);											// The mapping holds the file open.
+	if (p == MAP_FAILED){
+		sprintf(g.logbuf, "initJournal() Could not map %s. Error: %s\n", f.journal_file, strerror(errno));
+		writeToLog(g.logbuf, "initJournal()");
+		return -1;
+	}
+	jl.j = (struct ppsJournal *)p;
+
+	if (! isValid || jl.j->magic != PPS_JOURNAL_MAGIC || jl.j->version != PPS_JOURNAL_VERSION
+			|| jl.j->recordSize != sizeof(struct ppsJournalRecord) || jl.j->len != PPS_JOURNAL_LEN){
+		resetJournal(jl.j);
+	}
+	return 0;
+}
+
+/**
+ * Syncs and unmaps the journal file. Called after
+ * the writer thread has stopped.
+ */
+void freeJournal(void){
+	if (jl.j == NULL){
+		return;
+	}
+	msync(jl.j, sizeof(struct ppsJournal), MS_SYNC);
+	munmap(jl.j, sizeof(struct ppsJournal));
+	jl.j = NULL;
+}
+
+/**
+ * Appends an event record to the journal. Called by the
+ * writer thread or, if it is not running, by journalEvent().
+ *
+ * @param[in] rec The record. Its \b index is set here.
+ */
+void appendJournalRecord(const struct ppsJournalRecord *rec){
+	struct ppsJournal *j = jl.j;
+
+	if (j == NULL){
+		return;
+	}
+
+	uint64_t n = j->next;
+	struct ppsJournalRecord *r = &j->rec[n % PPS_JOURNAL_LEN];
+
+	__atomic_store_n(&r->index, 0, __ATOMIC_RELAXED);	// Being written
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	r->monoNs = rec->monoNs;
+	r->realSec = rec->realSec;
+	r->seq_num = rec->seq_num;
+	r->type = rec->type;
+	r->reserved = 0;
+	r->value[0] = rec->value[0];
+	r->value[1] = rec->value[1];
+
+	__atomic_store_n(&r->index, n + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&j->next, n + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Records an event and passes it to the writer thread
+ * to be appended to the journal. The event is dropped
+ * if the writer queue is full. Called only from the
+ * controller thread.
+ *
+ * @param[in] type One of the PPS_EVENT_ types.
+ * @param[in] value0 The first value of the event.
+ * @param[in] value1 The second value of the event.
+ */
+void journalEvent(int type, double value0, double value1){
+	struct ppsJournalRecord r;
+	struct timespec t_mono, t_rt;
+
+	if (jl.j == NULL){
+		return;
+	}
+
+	clk->getTime(CLOCK_MONOTONIC, &t_mono);
+	clk->getTime(CLOCK_REALTIME, &t_rt);
+
+	memset(&r, 0, sizeof(struct ppsJournalRecord));
+	r.monoNs = (int64_t)t_mono.tv_sec * NSECS_PER_SEC + t_mono.tv_nsec;
+	r.realSec = t_rt.tv_sec;
+	r.seq_num = g.seq_num;
+	r.type = (uint16_t)type;
+	r.value[0] = value0;
+	r.value[1] = value1;
+
+	if (queueJournal(&r) == -1){
+		appendJournalRecord(&r);
+	}
+}
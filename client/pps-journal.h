@@ -0,0 +1,123 @@
+/**
+ * @file pps-journal.h
+ *
+ * @brief This file contains the layout of the event journal
+ * written by the PPS-Client daemon.
+ *
+ * The header is self-contained so that programs that read the
+ * journal can include it without the rest of the PPS-Client
+ * headers.
+ *
+ * The journal is a memory-mapped file, by default
+ * /var/log/pps-journal, holding a ring of fixed-size records of
+ * the state transitions of the controller: restarts, external
+ * changes to the system clock, corrections of the fractional and
+ * whole seconds and the loss and resumption of the PPS. Record
+ * \b n, counting from zero since the journal was created, is held
+ * in \b rec[n % PPS_JOURNAL_LEN] until it is overwritten
+ * PPS_JOURNAL_LEN records later. The journal continues across
+ * restarts of the daemon.
+ *
+ * The daemon clears the \b index of a record before rewriting it
+ * and sets it to n + 1 afterward, then advances \b next. A reader
+ * copies a record and keeps it only if \b index was n + 1 both
+ * before and after the copy.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PPS_JOURNAL_H_
+#define PPS_JOURNAL_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PPS_JOURNAL_FILE "/var/log/pps-journal"		//!< Default location of the journal
+
+#define PPS_JOURNAL_MAGIC 0x5050534A				//!< "PPSJ"
+#define PPS_JOURNAL_VERSION 1
+#define PPS_JOURNAL_LEN 16384						//!< Records in the ring. Must be a power of 2.
+
+#define PPS_EVENT_START 1							//!< The daemon started
+#define PPS_EVENT_EXIT 2							//!< The daemon is exiting
+#define PPS_EVENT_RESTART 3							//!< The controller restarted. value[0]: average time slew in usec, value[1]: 1 if restarting from a restored state
+#define PPS_EVENT_CLOCK_CHANGED 4					//!< The system time was set externally. value[0]: change in seconds
+#define PPS_EVENT_FRACTIONAL_ERROR 5				//!< An error in the fractional second was detected. value[0]: error in usec
+#define PPS_EVENT_FRACTIONAL_CORRECTION 6			//!< The fractional second was corrected. value[0]: correction in usec
+#define PPS_EVENT_NIST_CORRECTION 7					//!< The whole seconds were set from NIST. value[0]: correction in seconds, value[1]: -1 if adjtimex() failed
+#define PPS_EVENT_SERIAL_CORRECTION 8				//!< The whole seconds were set from GPS. value[0]: correction in seconds, value[1]: -1 if adjtimex() failed
+#define PPS_EVENT_MISSED_PPS 9						//!< PPS interrupts were missed. value[0]: number missed
+#define PPS_EVENT_PPS_LOST 10						//!< The PPS interrupt was lost. value[0]: seconds without a PPS
+#define PPS_EVENT_PPS_RESUMED 11					//!< The PPS interrupt resumed. value[0]: seconds without a PPS
+#define PPS_NUM_EVENTS 12
+
+/**
+ * A journal record.
+ */
+struct ppsJournalRecord {
+	uint64_t index;						//!< Position of the record in the journal plus one. Zero while the record is being written.
+	int64_t monoNs;						//!< CLOCK_MONOTONIC in nanoseconds at the event
+	int64_t realSec;					//!< CLOCK_REALTIME whole seconds at the event
+	uint32_t seq_num;					//!< PPS interrupts received since PPS-Client was started
+	uint16_t type;						//!< One of the PPS_EVENT_ types
+	uint16_t reserved;
+	double value[2];					//!< Values of the event, as listed with the PPS_EVENT_ types
+};
+
+/**
+ * The journal file.
+ */
+struct ppsJournal {
+	uint32_t magic;						//!< PPS_JOURNAL_MAGIC once the journal is initialized
+	uint32_t version;					//!< PPS_JOURNAL_VERSION
+	uint32_t recordSize;				//!< sizeof(struct ppsJournalRecord)
+	uint32_t len;						//!< PPS_JOURNAL_LEN
+	uint64_t next;						//!< Records written since the journal was created
+	uint64_t reserved[5];
+	struct ppsJournalRecord rec[PPS_JOURNAL_LEN];
+};
+
+/**
+ * Copies record \b n of the journal at \b j into \b out.
+ *
+ * @param[in] j The mapped journal.
+ * @param[in] n The position of the record in the journal.
+ * @param[out] out The record.
+ *
+ * @returns 0 on success, else -1 if the record has been
+ * overwritten or is being written.
+ */
+static inline int ppsReadJournalRecord(const struct ppsJournal *j, uint64_t n, struct ppsJournalRecord *out){
+	const struct ppsJournalRecord *r = &j->rec[n % PPS_JOURNAL_LEN];
+
+	if (__atomic_load_n(&r->index, __ATOMIC_ACQUIRE) != n + 1){
+		return -1;
+	}
+
+	memcpy(out, r, sizeof(struct ppsJournalRecord));
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&r->index, __ATOMIC_RELAXED) != n + 1){
+		return -1;
+	}
+	out->index = n + 1;
+	return 0;
+}
+
+#endif /* PPS_JOURNAL_H_ */
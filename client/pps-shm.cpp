@@ -0,0 +1,314 @@
+/**
+ * @file pps-shm.cpp
+ * @brief This file contains the functions that publish PPS-Client
+ * records to shared memory.
+ *
+ * The record layouts and the reader side are in pps-shm.h.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+#include <limits.h>
+
+extern struct G g;
+extern struct ppsFiles f;
+
+/**
+ * Local file-scope shared variables.
+ */
+static struct shmLocalVars {
+	struct ppsTimestamp *ts;						// The mapped timestamp record
+	struct ppsStatus *st;							// The mapped status block
+} s = {NULL, NULL};
+
+/**
+ * Maps a record file in the shm directory for
+ * writing, creating the file if necessary.
+ *
+ * @param[in] filename The record file.
+ * @param[in] sz The size of the record.
+ * @param[in] location The calling function.
+ *
+ * @returns A pointer to the mapped record or
+ * NULL on error.
+ */
+static void *mapShmFile(const char *filename, size_t sz, const char *location){
+	mode_t mode = S_IWUSR | S_IRUSR | S_IRGRP | S_IROTH;
+
+	int fd = open(filename, O_CREAT | O_RDWR, mode);
+	if (fd == -1){
+		couldNotOpenMsgTo(g.logbuf, filename, location);
+		writeToLog(g.logbuf, location);
+		return NULL;
+	}
+
+	if (ftruncate(fd, sz) == -1){
+		sprintf(g.logbuf, "%s Could not size %s. Error: %s\n", location, filename, strerror(errno));
+		writeToLog(g.logbuf, location);
+		close(fd);
+		return NULL;
+	}
+
+	void *p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);											// The mapping holds the file open.
+	if (p == MAP_FAILED){
+		sprintf(g.logbuf, "%s Could not map %s. Error: %s\n", location, filename, strerror(errno));
+		writeToLog(g.logbuf, location);
+		return NULL;
+	}
+	return p;
+}
+
+/**
+ * Wakes all readers waiting in ppsWaitForUpdate()
+ * for a record to be published. The FUTEX_WAKE system
+ * call is made only if a reader has counted itself in
+ * \b waiters, so that the controller thread makes no
+ * system call here when nobody is waiting.
+ *
+ * @param[in] word The sequence word of the record.
+ * @param[in] waiters The waiter count of the record.
+ */
+static void wakeWaiters(uint32_t *word, uint32_t *waiters){
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);			// The sequence word is stored before the count
+														// is loaded. Pairs with ppsWaitForUpdate().
+	if (__atomic_load_n(waiters, __ATOMIC_RELAXED) != 0){
+		syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+/**
+ * Gets the PPS_STATUS_ flags for the current
+ * controller state.
+ */
+static uint32_t getStatusFlags(void){
+	uint32_t status = PPS_STATUS_RUNNING;
+
+	if (g.isControlling){
+		status |= PPS_STATUS_CONTROLLING;
+	}
+	if (g.isDelaySpike){
+		status |= PPS_STATUS_DELAY_SPIKE;
+	}
+	if (g.clockChanged){
+		status |= PPS_STATUS_CLOCK_CHANGED;
+	}
+	if (g.interruptLossCount > 0){
+		status |= PPS_STATUS_INTERRUPT_LOST;
+	}
+	return status;
+}
+
+/**
+ * Maps the timestamp record file in the shm
+ * directory, creating the file if necessary.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int initTimestampShm(void){
+
+	if (s.ts != NULL){
+		return 0;
+	}
+
+	s.ts = (struct ppsTimestamp *)mapShmFile(f.timestamp_file, sizeof(struct ppsTimestamp), "initTimestampShm()");
+	if (s.ts == NULL){
+		return -1;
+	}
+
+	__atomic_store_n(&s.ts->magic, 0, __ATOMIC_RELEASE);	// Hide the record from readers while
+	uint32_t waiters = s.ts->waiters;						// it is initialized. Readers still
+	memset(s.ts, 0, sizeof(struct ppsTimestamp));			// waiting from the last run stay counted.
+	s.ts->waiters = waiters;
+	s.ts->version = PPS_SHM_VERSION;
+	__atomic_store_n(&s.ts->magic, PPS_SHM_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * Clears the running status of the timestamp
+ * record and unmaps it. The file is left in
+ * place so that readers see that the daemon
+ * has stopped.
+ */
+void freeTimestampShm(void){
+	if (s.ts == NULL){
+		return;
+	}
+
+	__atomic_store_n(&s.ts->seq, s.ts->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s.ts->status &= ~PPS_STATUS_RUNNING;
+	__atomic_store_n(&s.ts->seq, s.ts->seq + 1, __ATOMIC_RELEASE);
+	wakeWaiters(&s.ts->seq, &s.ts->waiters);
+
+	munmap(s.ts, sizeof(struct ppsTimestamp));
+	s.ts = NULL;
+}
+
+/**
+ * Publishes the time of the PPS rising edge along
+ * with the current controller state to the timestamp
+ * record.
+ *
+ * @param[in] sec Whole seconds of the PPS time.
+ * @param[in] nsec Nanoseconds of the PPS time.
+ */
+void publishTimestamp(int64_t sec, int32_t nsec){
+	struct ppsTimestamp *ts = s.ts;
+
+	if (ts == NULL){
+		return;
+	}
+
+	uint32_t status = getStatusFlags();
+
+	__atomic_store_n(&ts->seq, ts->seq + 1, __ATOMIC_RELAXED);	// Odd: write in progress
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	ts->status = status;
+	ts->sec = sec;
+	ts->nsec = nsec;
+	ts->seq_num = g.seq_num;
+	ts->timeCorrection = g.timeCorrection / g.usecScale;
+	ts->hardLimit = g.hardLimit;
+	ts->freqOffset = g.freqOffset;
+
+	__atomic_store_n(&ts->seq, ts->seq + 1, __ATOMIC_RELEASE);	// Even: record is consistent
+	wakeWaiters(&ts->seq, &ts->waiters);
+}
+
+/**
+ * Returns the mapped timestamp record for readers
+ * within the daemon or NULL if it is not mapped.
+ */
+const struct ppsTimestamp *getTimestampShm(void){
+	return s.ts;
+}
+
+/**
+ * Maps the status block file in the shm directory,
+ * creating the file if necessary.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int initStatusShm(void){
+
+	if (s.st != NULL){
+		return 0;
+	}
+
+	s.st = (struct ppsStatus *)mapShmFile(f.status_file, sizeof(struct ppsStatus), "initStatusShm()");
+	if (s.st == NULL){
+		return -1;
+	}
+
+	__atomic_store_n(&s.st->magic, 0, __ATOMIC_RELEASE);
+	uint32_t waiters = s.st->waiters;
+	memset(s.st, 0, sizeof(struct ppsStatus));
+	s.st->waiters = waiters;
+	s.st->version = PPS_STATUS_VERSION;
+	__atomic_store_n(&s.st->magic, PPS_STATUS_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * Clears the running status of the status block
+ * and unmaps it.
+ */
+void freeStatusShm(void){
+	if (s.st == NULL){
+		return;
+	}
+
+	__atomic_store_n(&s.st->generation, s.st->generation + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s.st->params.status &= ~(PPS_STATUS_RUNNING | PPS_STATUS_PARAMS_VALID);
+	__atomic_store_n(&s.st->generation, s.st->generation + 1, __ATOMIC_RELEASE);
+	wakeWaiters(&s.st->generation, &s.st->waiters);
+
+	munmap(s.st, sizeof(struct ppsStatus));
+	s.st = NULL;
+}
+
+/**
+ * Gets the current status line parameters.
+ *
+ * @param[out] p The parameters.
+ */
+void getStatusParams(struct ppsStatusParams *p){
+	p->pps_sec = g.pps_t_sec;
+	p->pps_usec = g.pps_t_usec;
+	p->seq_num = g.seq_num;
+	p->jitter = g.jitter;
+	p->hardLimit = g.hardLimit;
+	p->freqOffset = g.freqOffset;
+	p->avgCorrection = g.avgCorrection;
+	p->status = getStatusFlags();
+	p->clampAbsolute = g.clampAbsolute;
+}
+
+/**
+ * Publishes the status line parameters and the
+ * status messages in msgs to the status block.
+ * Each line of msgs becomes one message in the
+ * message ring.
+ *
+ * @param[in] msgs The status messages accumulated
+ * since the last call.
+ * @param[in] hasParams "true" if the parameters
+ * are a status line for this second.
+ */
+void publishStatus(const char *msgs, bool hasParams){
+	struct ppsStatus *st = s.st;
+
+	if (st == NULL){
+		return;
+	}
+
+	__atomic_store_n(&st->generation, st->generation + 1, __ATOMIC_RELAXED);	// Odd: write in progress
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	getStatusParams(&st->params);
+	if (hasParams){
+		st->params.status |= PPS_STATUS_PARAMS_VALID;
+	}
+	st->latency = g.phaseLatency;
+
+	const char *line = msgs;
+	while (*line != '\0'){
+		const char *end = strchr(line, '\n');
+		int len = (end == NULL) ? strlen(line) : end - line + 1;
+
+		char *msg = st->msgs[st->msgCount % PPS_MSG_RING_LEN];
+		int n = (len < PPS_MSG_LEN) ? len : PPS_MSG_LEN - 2;
+		memcpy(msg, line, n);
+		if (n < len){
+			msg[n++] = '\n';								// Truncated
+		}
+		msg[n] = '\0';
+
+		st->msgCount += 1;
+		line += len;
+	}
+
+	__atomic_store_n(&st->generation, st->generation + 1, __ATOMIC_RELEASE);	// Even: block is consistent
+	wakeWaiters(&st->generation, &st->waiters);
+}
@@ -0,0 +1,323 @@
+/**
+ * @file pps-shm.h
+ *
+ * @brief This file contains the layout of the shared memory
+ * records published by the PPS-Client daemon.
+ *
+ * The header is self-contained so that programs that consume
+ * the PPS timestamp or status can include it without the rest of the
+ * PPS-Client headers.
+ *
+ * The daemon publishes two records, each in its own memory-mapped
+ * file that is rewritten once each second:
+ *
+ * - The timestamp record, by default /run/shm/pps-timestamp, that
+ *   holds the time of the most recent PPS.
+ * - The status block, by default /run/shm/pps-status, that holds
+ *   the controller parameters shown by "pps-client -v" along with
+ *   a bounded ring of the most recent status messages.
+ *
+ * Each record is protected by a sequence lock: the daemon makes the
+ * sequence word odd before changing the record and even again
+ * afterward. A reader copies the record and retries if the word was
+ * odd or changed during the copy. No system calls are made to read
+ * a record once its file has been mapped.
+ *
+ * The sequence word of each record is also a futex. A reader that
+ * calls ppsWaitForUpdate() counts itself in the \b waiters word of
+ * the record while it sleeps on the futex, and the daemon wakes the
+ * futex after publishing the record only if that count is nonzero,
+ * so the reader wakes as soon as each new PPS sample has been
+ * processed and the daemon makes no system call when nobody waits.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PPS_SHM_H_
+#define PPS_SHM_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define PPS_TIMESTAMP_SHM "/run/shm/pps-timestamp"	//!< Default location of the timestamp record
+#define PPS_STATUS_SHM "/run/shm/pps-status"			//!< Default location of the status block
+
+#define PPS_SHM_MAGIC 0x50505354					//!< "PPST"
+#define PPS_SHM_VERSION 2
+#define PPS_STATUS_MAGIC 0x50505353					//!< "PPSS"
+#define PPS_STATUS_VERSION 4
+#define PPS_SHM_READ_TRIES 100						//!< Read attempts before \b ppsSeqlockRead() gives up
+#define PPS_SHM_POLL_NSEC 10000000					//!< Poll interval of \b ppsWaitForUpdate() on a read-only mapping
+
+#define PPS_STATUS_RUNNING 0x01						//!< The daemon is running and updating the record
+#define PPS_STATUS_CONTROLLING 0x02					//!< The controller is controlling the system clock
+#define PPS_STATUS_DELAY_SPIKE 0x04					//!< The last PPS interrupt was delayed
+#define PPS_STATUS_CLOCK_CHANGED 0x08				//!< An external change to the system clock was detected
+#define PPS_STATUS_INTERRUPT_LOST 0x10				//!< The last PPS interrupt was not received
+#define PPS_STATUS_PARAMS_VALID 0x20				//!< The status block params are a status line for this second
+
+#define PPS_PHASE_FETCH 0							//!< The PPS timestamp has been fetched
+#define PPS_PHASE_CORRECTION 1						//!< makeTimeCorrection() has returned
+#define PPS_PHASE_STATUS 2							//!< The state params and status have been published
+#define PPS_PHASE_CONFIG 3							//!< getConfigs() has returned
+#define PPS_NUM_PHASES 4
+
+#define PPS_MSG_RING_LEN 32							//!< Number of status messages kept in the status block
+#define PPS_MSG_LEN 256								//!< Maximum length of a status message including the '\0'
+
+/**
+ * The PPS timestamp record. The time of the PPS
+ * rising edge is \b sec + \b nsec * 1e-9 seconds.
+ */
+struct ppsTimestamp {
+	uint32_t magic;						//!< PPS_SHM_MAGIC once the record is initialized
+	uint32_t version;					//!< PPS_SHM_VERSION
+	uint32_t seq;						//!< Sequence lock. Odd while the record is being written.
+	uint32_t status;					//!< PPS_STATUS_ flags
+	int64_t sec;						//!< Whole seconds of the PPS rising edge
+	int32_t nsec;						//!< Nanoseconds of the PPS rising edge
+	uint32_t seq_num;					//!< PPS interrupts received since PPS-Client was started
+	int32_t timeCorrection;				//!< Time correction in microseconds applied at the PPS
+	int32_t hardLimit;					//!< Hard limit in microseconds applied to the time error
+	double freqOffset;					//!< Frequency offset of the system clock in parts per million
+	uint32_t waiters;					//!< Readers sleeping in ppsWaitForUpdate() on \b seq
+	uint32_t reserved[7];
+};
+
+/**
+ * The controller parameters that make up the status
+ * line of "pps-client -v".
+ */
+struct ppsStatusParams {
+	int64_t pps_sec;					//!< Whole seconds of the PPS rising edge
+	int32_t pps_usec;					//!< Microseconds of the PPS rising edge
+	uint32_t seq_num;					//!< PPS interrupts received since PPS-Client was started
+	int32_t jitter;						//!< Time deviation in microseconds at the PPS interrupt
+	int32_t hardLimit;					//!< Hard limit in microseconds applied to the time error
+	double freqOffset;					//!< Frequency offset of the system clock in parts per million
+	double avgCorrection;				//!< Time corrections in microseconds averaged over the last minute
+	uint32_t status;					//!< PPS_STATUS_ flags
+	int32_t clampAbsolute;				//!< Nonzero if the hard limit is an absolute limit
+};
+
+/**
+ * The time in microseconds from the wakeup of the
+ * one-second loop of the daemon, \b window microseconds
+ * before the expected PPS, to the end of each phase of
+ * the work done for a PPS, indexed by PPS_PHASE_.
+ */
+struct ppsPhaseLatency {
+	uint32_t count[PPS_NUM_PHASES];		//!< Seconds in which the phase ran since the controller started
+	int32_t last[PPS_NUM_PHASES];		//!< Latency in the last second in which the phase ran
+	int32_t max[PPS_NUM_PHASES];		//!< Largest latency since the controller started
+	int32_t window;						//!< Current adaptive PPS_WINDOW
+	int32_t lateness;					//!< Estimated high quantile of the lateness of the wakeup
+	uint32_t missed;					//!< Wakeups whose deadline had passed before the sleep
+};
+
+/**
+ * The status block. Status message \b n, counting from
+ * zero since the daemon started, is held in
+ * \b msgs[n % PPS_MSG_RING_LEN] until it is overwritten
+ * PPS_MSG_RING_LEN messages later.
+ */
+struct ppsStatus {
+	uint32_t magic;						//!< PPS_STATUS_MAGIC once the block is initialized
+	uint32_t version;					//!< PPS_STATUS_VERSION
+	uint32_t generation;				//!< Sequence lock. Odd while the block is being written.
+	uint32_t msgCount;					//!< Status messages published since the daemon started
+	uint32_t waiters;					//!< Readers sleeping in ppsWaitForUpdate() on \b generation
+	uint32_t reserved;
+	struct ppsStatusParams params;
+	struct ppsPhaseLatency latency;
+	char msgs[PPS_MSG_RING_LEN][PPS_MSG_LEN];
+};
+
+/**
+ * Copies a consistent snapshot of a record protected
+ * by the sequence lock \b seq.
+ *
+ * @param[in] seq The sequence word of the record.
+ * @param[in] src The mapped record.
+ * @param[out] dst The snapshot.
+ * @param[in] sz The size of the record.
+ *
+ * @returns The sequence word of the snapshot or
+ * -1 if the record could not be read consistently.
+ */
+static inline int64_t ppsSeqlockRead(const uint32_t *seq, const void *src, void *dst, size_t sz){
+
+	for (int i = 0; i < PPS_SHM_READ_TRIES; i++){
+		uint32_t seq0 = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		if (seq0 & 1){
+			continue;
+		}
+
+		memcpy(dst, src, sz);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(seq, __ATOMIC_RELAXED) == seq0){
+			return seq0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Copies a consistent snapshot of the timestamp
+ * record at \b shm into \b out.
+ *
+ * @param[in] shm The mapped record.
+ * @param[out] out The snapshot.
+ *
+ * @returns 0 on success, else -1 if the record is not
+ * initialized, has another layout version or could not
+ * be read consistently.
+ */
+static inline int ppsReadTimestamp(const struct ppsTimestamp *shm, struct ppsTimestamp *out){
+
+	if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != PPS_SHM_MAGIC
+			|| shm->version != PPS_SHM_VERSION){		// Set before the magic
+		return -1;
+	}
+
+	int64_t seq = ppsSeqlockRead(&shm->seq, shm, out, sizeof(struct ppsTimestamp));
+	if (seq == -1){
+		return -1;
+	}
+	out->seq = (uint32_t)seq;
+	return 0;
+}
+
+/**
+ * Copies a consistent snapshot of the status block
+ * at \b shm into \b out.
+ *
+ * @param[in] shm The mapped status block.
+ * @param[out] out The snapshot.
+ *
+ * @returns 0 on success, else -1 if the block is not
+ * initialized, has another layout version or could not
+ * be read consistently.
+ */
+static inline int ppsReadStatus(const struct ppsStatus *shm, struct ppsStatus *out){
+
+	if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != PPS_STATUS_MAGIC
+			|| shm->version != PPS_STATUS_VERSION){		// Set before the magic
+		return -1;
+	}
+
+	int64_t gen = ppsSeqlockRead(&shm->generation, shm, out, sizeof(struct ppsStatus));
+	if (gen == -1){
+		return -1;
+	}
+	out->generation = (uint32_t)gen;
+	return 0;
+}
+
+/**
+ * Waits until the record whose sequence word is \b seq
+ * has been published since the snapshot with sequence
+ * word \b last was taken.
+ *
+ * For example, to process each new PPS timestamp:
+ *
+ *     ppsReadTimestamp(shm, &ts);
+ *     for (;;){
+ *         ppsWaitForUpdate(&shm->seq, &shm->waiters, ts.seq, &timeout);
+ *         ppsReadTimestamp(shm, &ts);
+ *         ...
+ *     }
+ *
+ * The caller is counted in \b waiters while it sleeps on
+ * the futex so that the daemon wakes the futex only when
+ * someone is waiting. The count is incremented before
+ * \b seq is compared again by FUTEX_WAIT, so a record
+ * published in between is either seen by the comparison
+ * or published after the daemon has seen the count.
+ *
+ * A reader that could only map the record read-only
+ * passes NULL for \b waiters. It cannot be counted, so
+ * it polls \b seq every PPS_SHM_POLL_NSEC nanoseconds.
+ *
+ * @param[in] seq The sequence word of the mapped record.
+ * @param[in,out] waiters The waiter count of the mapped
+ * record or NULL if the mapping is read-only.
+ * @param[in] last The sequence word of the last snapshot.
+ * @param[in] timeout The longest time to wait or NULL
+ * to wait indefinitely.
+ *
+ * @returns 0 when the record has been published, else
+ * -1 with errno set to ETIMEDOUT on timeout or EINTR if
+ * interrupted by a signal.
+ */
+static inline int ppsWaitForUpdate(const uint32_t *seq, uint32_t *waiters, uint32_t last, const struct timespec *timeout){
+
+	int64_t left = -1;											// Nanoseconds left to poll or -1 if no timeout
+	if (timeout != NULL){
+		left = (int64_t)timeout->tv_sec * 1000000000 + timeout->tv_nsec;
+	}
+
+	for (;;){
+		uint32_t cur = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		if (cur != last && (cur & 1) == 0){
+			return 0;
+		}
+
+		if (waiters == NULL){
+			if (left == 0){
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			struct timespec poll = {0, PPS_SHM_POLL_NSEC};
+			if (left >= 0 && left < PPS_SHM_POLL_NSEC){
+				poll.tv_nsec = (long)left;
+			}
+			if (nanosleep(&poll, NULL) == -1){
+				return -1;
+			}
+			if (left > 0){
+				left -= poll.tv_nsec;
+			}
+			continue;
+		}
+
+		__atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);
+															// Not FUTEX_PRIVATE_FLAG: the word is shared
+		long rv = syscall(SYS_futex, seq, FUTEX_WAIT, cur, timeout, NULL, 0);	// between processes.
+		int err = errno;
+
+		uint32_t n = __atomic_load_n(waiters, __ATOMIC_RELAXED);
+		while (n != 0 && ! __atomic_compare_exchange_n(waiters, &n, n - 1, false,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED)){		// Not below zero if the daemon
+		}												// cleared the record while waiting.
+
+		if (rv == -1 && (err == ETIMEDOUT || err == EINTR)){
+			errno = err;
+			return -1;
+		}
+	}
+}
+
+#endif /* PPS_SHM_H_ */
@@ -0,0 +1,191 @@
+/**
+ * @file pps-stability.cpp
+ * @brief This file contains the streaming stability analysis of
+ * the system clock.
+ *
+ * The time error of the system clock measured at each PPS while
+ * the controller is controlling is the phase record from which
+ * the overlapping Allan deviation (ADEV), the modified Allan
+ * deviation (MDEV) and the time deviation (TDEV) are accumulated
+ * at octave intervals, tau, from 1 second to 2^17 seconds.
+ *
+ * Each term of the deviations is a second difference of the phase
+ * at spacing tau and, for MDEV, of the phase averaged over tau. The
+ * averages come from differences of a running sum of the phase, so
+ * each second adds one term to each deviation at a fixed cost.
+ * Taus up to STABILITY_BLOCK seconds are computed from every second,
+ * which needs the running sum over the last 3 * STABILITY_BLOCK
+ * seconds. Larger taus are computed from the phase and the running
+ * sum at the start of each block of STABILITY_BLOCK seconds, so
+ * their terms overlap in steps of a block instead of a second. The
+ * memory used is fixed whatever the length of the record.
+ *
+ * Seconds missed because of a delay spike or a lost PPS are filled
+ * with the last phase. The analysis starts over after a gap longer
+ * than STABILITY_MAX_GAP seconds and when the controller restarts.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+
+extern struct G g;
+
+#define FINE_MASK (STABILITY_FINE_LEN - 1)
+#define COARSE_MASK (STABILITY_COARSE_LEN - 1)
+
+/**
+ * Adds the terms ending at the newest second to the
+ * deviations at the taus computed from every second.
+ */
+static void addFineTerms(struct stabilityVars *sv){
+	const double *P = sv->fineSum;
+	int64_t N = sv->n;									// P[N] is the sum of the first N phases
+
+	for (int k = 0; k < STABILITY_FINE_TAUS; k++){
+		int64_t m = (int64_t)1 << k;
+
+		if (N >= 2 * m + 1){
+			double x0 = P[N & FINE_MASK] - P[(N - 1) & FINE_MASK];
+			double x1 = P[(N - m) & FINE_MASK] - P[(N - m - 1) & FINE_MASK];
+			double x2 = P[(N - 2 * m) & FINE_MASK] - P[(N - 2 * m - 1) & FINE_MASK];
+			double d = x0 - 2.0 * x1 + x2;
+			sv->adevSum[k] += d * d;
+			sv->adevN[k] += 1;
+		}
+		if (N >= 3 * m){
+			double d = (P[N & FINE_MASK] - 3.0 * P[(N - m) & FINE_MASK]
+					+ 3.0 * P[(N - 2 * m) & FINE_MASK] - P[(N - 3 * m) & FINE_MASK]) / (double)m;
+			sv->mdevSum[k] += d * d;
+			sv->mdevN[k] += 1;
+		}
+	}
+}
+
+/**
+ * Adds the terms ending at the newest block to the
+ * deviations at the taus computed from blocks.
+ */
+static void addCoarseTerms(struct stabilityVars *sv){
+	const double *X = sv->blockPhase;
+	const double *Q = sv->blockSum;
+	int64_t B = sv->nBlocks;							// X[B - 1] is the phase at the start of the newest block
+
+	for (int k = STABILITY_FINE_TAUS; k < STABILITY_TAUS; k++){
+		int64_t m = (int64_t)1 << (k - STABILITY_FINE_TAUS + 1);	// Blocks in tau
+
+		if (B >= 2 * m + 1){
+			double d = X[(B - 1) & COARSE_MASK] - 2.0 * X[(B - 1 - m) & COARSE_MASK]
+					+ X[(B - 1 - 2 * m) & COARSE_MASK];
+			sv->adevSum[k] += d * d;
+			sv->adevN[k] += 1;
+		}
+		if (B >= 3 * m + 1){							// Q[B - 1] is the sum to the start of the newest block
+			int64_t b = B - 1;
+			double d = (Q[b & COARSE_MASK] - 3.0 * Q[(b - m) & COARSE_MASK]
+					+ 3.0 * Q[(b - 2 * m) & COARSE_MASK] - Q[(b - 3 * m) & COARSE_MASK])
+					/ (double)(m * STABILITY_BLOCK);
+			sv->mdevSum[k] += d * d;
+			sv->mdevN[k] += 1;
+		}
+	}
+}
+
+/**
+ * Adds the phase of one second to the analysis.
+ */
+static void addPhase(struct stabilityVars *sv, double x){
+
+	if (sv->n % STABILITY_BLOCK == 0){					// Start of a block
+		sv->blockPhase[sv->nBlocks & COARSE_MASK] = x;
+		sv->blockSum[sv->nBlocks & COARSE_MASK] = sv->fineSum[sv->n & FINE_MASK];
+		sv->nBlocks += 1;
+		addCoarseTerms(sv);
+	}
+
+	sv->fineSum[(sv->n + 1) & FINE_MASK] = sv->fineSum[sv->n & FINE_MASK] + x;
+	sv->n += 1;
+	sv->lastPhase = x;
+
+	addFineTerms(sv);
+}
+
+/**
+ * Records the time error of the system clock at a PPS.
+ *
+ * @param[in] t The second of the PPS.
+ * @param[in] phase The time error in microseconds.
+ */
+void recordStability(int64_t t, double phase){
+	struct stabilityVars *sv = &g.stab;
+
+	if (sv->n > 0){
+		int64_t gap = t - sv->lastSec;
+		if (gap <= 0){
+			return;
+		}
+		if (gap > STABILITY_MAX_GAP){
+			memset(sv, 0, sizeof(struct stabilityVars));
+		}
+		else {
+			for (int64_t i = 1; i < gap; i++){
+				addPhase(sv, sv->lastPhase);
+			}
+		}
+	}
+	addPhase(sv, phase);
+	sv->lastSec = t;
+}
+
+/**
+ * Writes a line for each tau with the tau in seconds, the
+ * overlapping Allan deviation and the modified Allan deviation
+ * of the fractional frequency, the time deviation in nanoseconds
+ * and the number of terms in the overlapping Allan deviation.
+ * Taus without terms are not written.
+ *
+ * @param[in] fd The file or socket to write to.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int writeStabilityTo(int fd){
+	char buf[CTL_PACKET_SZ];
+	const struct stabilityVars *sv = &g.stab;
+	int len = 0;
+
+	for (int k = 0; k < STABILITY_TAUS; k++){
+		if (sv->adevN[k] == 0){
+			break;
+		}
+		double tau = (double)((int64_t)1 << k);
+		double adev = sqrt(sv->adevSum[k] / (2.0 * tau * tau * sv->adevN[k])) * 1e-6;
+		double mdev = 0.0;
+		if (sv->mdevN[k] > 0){
+			mdev = sqrt(sv->mdevSum[k] / (2.0 * tau * tau * sv->mdevN[k])) * 1e-6;
+		}
+		double tdev = tau * mdev / sqrt(3.0) * 1e9;
+
+		len += sprintf(buf + len, "%.0lf %.3le %.3le %.3le %u\n", tau, adev, mdev, tdev, sv->adevN[k]);
+	}
+
+	if (len > 0 && write(fd, buf, len) == -1){
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file pps-stats.cpp
+ * @brief This file contains the streaming quantile sketches of
+ * the jitter and the time corrections of the controller.
+ *
+ * The distributions built by buildJitterDistrib() and
+ * buildErrorDistrib() have one bin per microsecond over a fixed
+ * range, so values outside the range collapse into the edge bins.
+ * A quantile sketch instead has bins whose width grows in
+ * proportion to the magnitude of the values they hold, in the
+ * manner of DDSketch, so any quantile from a few nanoseconds to
+ * the whole second is found to within SKETCH_ALPHA of its value
+ * while each sample remains a single increment.
+ *
+ * Sketches are mergeable by adding their bins. Each statistic
+ * keeps a sketch of all samples since the daemon started and a
+ * ring of SKETCH_INTERVALS sketches of SKETCH_INTERVAL seconds
+ * that are merged for the quantiles over the last hour. The
+ * sketches are not cleared by a controller restart.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+
+extern struct G g;
+
+struct sketchStream jitterSketch;					//!< Sketches of G.jitter in microseconds
+struct sketchStream correctionSketch;				//!< Sketches of G.timeCorrection in microseconds
+
+static const double lnGamma = log((1.0 + SKETCH_ALPHA) / (1.0 - SKETCH_ALPHA));
+
+/**
+ * Gets the sketch bin of a nonzero magnitude. Bin k
+ * holds magnitudes in (SKETCH_MIN_VALUE * gamma^(k-1),
+ * SKETCH_MIN_VALUE * gamma^k].
+ */
+static inline int sketchKey(double mag){
+	int k = (int)ceil(log(mag / SKETCH_MIN_VALUE) / lnGamma);
+	if (k < 0){
+		k = 0;
+	}
+	else if (k > SKETCH_LEN - 1){
+		k = SKETCH_LEN - 1;
+	}
+	return k;
+}
+
+/**
+ * Gets the magnitude that represents the values in
+ * sketch bin k to within SKETCH_ALPHA.
+ */
+static inline double sketchValue(int k){
+	double gamma = exp(lnGamma);
+	return SKETCH_MIN_VALUE * 2.0 * exp(lnGamma * k) / (gamma + 1.0);
+}
+
+/**
+ * Adds a value to a sketch.
+ *
+ * @param[in,out] sk The sketch.
+ * @param[in] val The value in microseconds.
+ */
+void sketchAdd(struct quantileSketch *sk, double val){
+
+	if (sk->count == 0 || val < sk->min){
+		sk->min = val;
+	}
+	if (sk->count == 0 || val > sk->max){
+		sk->max = val;
+	}
+	sk->count += 1;
+
+	if (val >= SKETCH_MIN_VALUE){
+		sk->pos[sketchKey(val)] += 1;
+	}
+	else if (val <= -SKETCH_MIN_VALUE){
+		sk->neg[sketchKey(-val)] += 1;
+	}
+	else {
+		sk->zero += 1;
+	}
+}
+
+/**
+ * Adds the values in sketch src to sketch dst.
+ */
+void sketchMerge(struct quantileSketch *dst, const struct quantileSketch *src){
+
+	if (src->count == 0){
+		return;
+	}
+	if (dst->count == 0 || src->min < dst->min){
+		dst->min = src->min;
+	}
+	if (dst->count == 0 || src->max > dst->max){
+		dst->max = src->max;
+	}
+	dst->count += src->count;
+	dst->zero += src->zero;
+
+	for (int i = 0; i < SKETCH_LEN; i++){
+		dst->pos[i] += src->pos[i];
+		dst->neg[i] += src->neg[i];
+	}
+}
+
+/**
+ * Gets the value at quantile q of the values in a sketch.
+ *
+ * @param[in] sk The sketch.
+ * @param[in] q The quantile from 0 to 1.
+ *
+ * @returns The value in microseconds or 0 if the
+ * sketch is empty.
+ */
+double sketchQuantile(const struct quantileSketch *sk, double q){
+
+	if (sk->count == 0){
+		return 0.0;
+	}
+
+	uint32_t rank = (uint32_t)(q * (double)(sk->count - 1));
+	uint32_t n = 0;
+	double val = sk->max;
+	bool found = false;
+
+	for (int i = SKETCH_LEN - 1; i >= 0 && ! found; i--){		// Most negative first
+		n += sk->neg[i];
+		if (n > rank){
+			val = -sketchValue(i);
+			found = true;
+		}
+	}
+	if (! found){
+		n += sk->zero;
+		if (n > rank){
+			val = 0.0;
+			found = true;
+		}
+	}
+	for (int i = 0; i < SKETCH_LEN && ! found; i++){
+		n += sk->pos[i];
+		if (n > rank){
+			val = sketchValue(i);
+			found = true;
+		}
+	}
+
+	if (val < sk->min){
+		val = sk->min;
+	}
+	else if (val > sk->max){
+		val = sk->max;
+	}
+	return val;
+}
+
+/**
+ * Adds a value to the sketches of a statistic, starting
+ * a new interval sketch every SKETCH_INTERVAL values.
+ *
+ * @param[in,out] ss The sketches of the statistic.
+ * @param[in] val The value in microseconds.
+ */
+void addStatsSample(struct sketchStream *ss, double val){
+
+	if (ss->intervalCount >= SKETCH_INTERVAL){
+		ss->current = (ss->current + 1) % SKETCH_INTERVALS;
+		memset(&ss->interval[ss->current], 0, sizeof(struct quantileSketch));
+		ss->intervalCount = 0;
+	}
+	ss->intervalCount += 1;
+
+	sketchAdd(&ss->interval[ss->current], val);
+	sketchAdd(&ss->total, val);
+}
+
+/**
+ * Appends one line of quantiles of a sketch to buf.
+ *
+ * @returns The length of the line.
+ */
+static int formatQuantiles(char *buf, const char *window, const struct quantileSketch *sk){
+	return sprintf(buf, "%-10s %10u %10.3lf %10.3lf %10.3lf %10.3lf %10.3lf %10.3lf %10.3lf\n",
+			window, sk->count, sk->min, sketchQuantile(sk, 0.5), sketchQuantile(sk, 0.9),
+			sketchQuantile(sk, 0.99), sketchQuantile(sk, 0.999), sketchQuantile(sk, 0.9999), sk->max);
+}
+
+/**
+ * Writes the count, minimum, p50, p90, p99, p99.9, p99.99
+ * and maximum in microseconds of a statistic over the current
+ * interval of up to SKETCH_INTERVAL seconds, over the last
+ * SKETCH_INTERVALS intervals (about the last hour) and since
+ * the daemon started.
+ *
+ * @param[in] fd The file or socket to write to.
+ * @param[in] ss The sketches of the statistic.
+ *
+ * @returns 0 on success, else -1 on error.
+ */
+int writeQuantilesTo(int fd, const struct sketchStream *ss){
+	char buf[CTL_PACKET_SZ];
+	struct quantileSketch *hour = new struct quantileSketch;
+
+	memset(hour, 0, sizeof(struct quantileSketch));
+	for (int i = 0; i < SKETCH_INTERVALS; i++){
+		sketchMerge(hour, &ss->interval[i]);
+	}
+
+	int len = sprintf(buf, "%-10s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+			"# window", "count", "min", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+	len += formatQuantiles(buf + len, "interval", &ss->interval[ss->current]);
+	len += formatQuantiles(buf + len, "hour", hour);
+	len += formatQuantiles(buf + len, "all", &ss->total);
+
+	delete hour;
+
+	if (write(fd, buf, len) == -1){
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file pps-thermal.cpp
+ * @brief This file contains the thermal feedforward of the
+ * system clock frequency.
+ *
+ * The frequency offset of the oscillator of the system clock
+ * changes with its temperature, which follows the CPU temperature
+ * when the processor load changes. The integral control of
+ * makeTimeCorrection() corrects the frequency only once a minute,
+ * so a change of temperature appears as a time error before the
+ * integral catches up.
+ *
+ * When thermal-feedforward is enabled, the CPU temperature, which
+ * the writer thread reads each second, is smoothed each second, and the frequency is changed each second
+ * by the thermal coefficient times the change in temperature. The
+ * coefficient, in ppm per degree C, is the slope of a decaying least
+ * squares fit of the frequency offset at each integral update against
+ * the smoothed temperature at the time. At each integral update the
+ * correction made since the last update is moved into the integrals,
+ * so the integral control continues from the corrected frequency and
+ * removes whatever the feedforward does not predict. The coefficient
+ * is kept across restarts of the controller.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+
+extern struct G g;
+extern struct clockBackend *clk;
+
+/**
+ * Local file-scope shared variables.
+ */
+static struct thermalLocalVars {
+	bool hasTemp;								// "true" once temp holds a reading
+	double temp;								// Smoothed CPU temperature in degrees C
+	double lastTemp;							// temp when the feedforward was last applied
+	double weight;								// Decayed count of the one minute samples
+	double meanTemp;							// Decaying means of the samples
+	double meanFreq;
+	double varTemp;								// Decaying co-moments of the samples
+	double covar;
+	bool isActive;								// "true" while the coefficient is used
+} th;
+
+/**
+ * Adds the frequency offset set at an integral update and
+ * the smoothed temperature to the statistics of the thermal
+ * coefficient.
+ */
+static void addThermalSample(double temp, double freqOffset){
+	th.weight = th.weight * THERMAL_DECAY + 1.0;
+
+	double dt = temp - th.meanTemp;
+	th.meanTemp += dt / th.weight;
+	th.meanFreq += (freqOffset - th.meanFreq) / th.weight;
+
+	th.varTemp = th.varTemp * THERMAL_DECAY + dt * (temp - th.meanTemp);
+	th.covar = th.covar * THERMAL_DECAY + dt * (freqOffset - th.meanFreq);
+}
+
+/**
+ * Gets the thermal coefficient once there are enough
+ * samples over a wide enough range of temperature.
+ *
+ * @param[out] coef The coefficient in ppm per degree C.
+ *
+ * @returns 0 on success, else -1 if the coefficient
+ * is not yet known.
+ */
+static int getThermalCoef(double *coef){
+	if (th.weight < THERMAL_MIN_SAMPLES || th.varTemp < THERMAL_MIN_VAR * th.weight){
+		return -1;
+	}
+	double k = th.covar / th.varTemp;
+	if (k > THERMAL_COEF_MAX){
+		k = THERMAL_COEF_MAX;
+	}
+	else if (k < -THERMAL_COEF_MAX){
+		k = -THERMAL_COEF_MAX;
+	}
+	*coef = k;
+	return 0;
+}
+
+/**
+ * Moves the feedforward correction made since the last
+ * integral update into the integrals. Called when a new
+ * integral is taken, before the new frequency offset is
+ * calculated from \b G.integralTimeCorrection.
+ */
+void foldThermalCorrection(void){
+	if (g.thermalCorrection == 0.0){
+		return;
+	}
+
+	double d = g.thermalCorrection / g.integralGain;
+	for (int i = 0; i < NUM_INTEGRALS; i++){
+		g.integral[i] += d;
+	}
+	g.integralTimeCorrection += d;
+	g.thermalCorrection = 0.0;
+}
+
+/**
+ * Gets the CPU temperature and, between integral updates,
+ * changes the system clock frequency by the thermal coefficient
+ * times the change in the smoothed temperature. At an integral
+ * update the new frequency offset is added to the statistics of
+ * the coefficient instead. Called each second while the controller
+ * is controlling. Does nothing unless thermal-feedforward is
+ * enabled.
+ *
+ * @param[in] isIntegralUpdate "true" if the frequency offset
+ * was updated from the integrals this second.
+ */
+void thermalFeedforward(bool isIntegralUpdate){
+	double temp, coef = 0.0;
+
+	if (! isEnabled(THERMAL_FEEDFORWARD) || clk->getTemperature(&temp) == -1){
+		th.hasTemp = false;
+		return;
+	}
+
+	if (! th.hasTemp){
+		th.temp = temp;
+		th.lastTemp = temp;
+		th.hasTemp = true;
+	}
+	th.temp += THERMAL_SMOOTHING * (temp - th.temp);
+
+	if (isIntegralUpdate){
+		if (g.activeCount >= SECS_PER_10_MIN){		// After the startup transient
+			addThermalSample(th.temp, g.freqOffset);
+		}
+		th.lastTemp = th.temp;
+		return;
+	}
+
+	bool isActive = (getThermalCoef(&coef) == 0);
+	if (isActive != th.isActive){
+		th.isActive = isActive;
+		if (isActive){
+			sprintf(g.logbuf, "Thermal feedforward started with coefficient %.3lf ppm/degC\n", coef);
+		}
+		else {
+			sprintf(g.logbuf, "Thermal feedforward stopped\n");
+		}
+		writeToLog(g.logbuf, "thermalFeedforward()");
+	}
+
+	double dTemp = th.temp - th.lastTemp;
+	th.lastTemp = th.temp;
+	if (! isActive || dTemp == 0.0){
+		return;
+	}
+
+	g.thermalCorrection += coef * dTemp;
+
+	g.t3.status = 0;
+	g.t3.modes = ADJ_FREQUENCY;
+	g.t3.freq = (long)round(ADJTIMEX_SCALE * (g.freqOffset + g.thermalCorrection));
+	clk->adjustClock(&g.t3);
+}
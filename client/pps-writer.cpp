@@ -0,0 +1,444 @@
+/**
+ * @file pps-writer.cpp
+ * @brief This file contains the thread that performs file writes for the PPS-Client controller.
+ *
+ * The controller runs at SCHED_FIFO priority inside the PPS time window
+ * and must never block on the file system. Log messages,
+ * distributions and the samples stored in memory-mapped files
+ * are instead copied into a lock-free
+ * single-producer/single-consumer ring by the controller thread and
+ * written to their files by a lower priority writer thread that owns
+ * all of the corresponding file descriptors.
+ */
+
+/*
+ * Copyright (C) 2016-2021  Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../client/pps-client.h"
+#include <atomic>
+#include <semaphore.h>
+
+extern struct G g;
+extern struct ppsFiles f;
+
+/**
+ * Local file-scope shared variables.
+ */
+static struct writerLocalVars {
+	struct writerMsg ring[WRITER_RING_LEN];
+	std::atomic<unsigned int> head;					// Next slot to fill. Written only by the producer.
+	std::atomic<unsigned int> tail;					// Next slot to drain. Written only by the writer thread.
+	std::atomic<bool> isRunning;
+	std::atomic<bool> exitRequested;
+	std::atomic<unsigned int> dropped;				// Messages dropped because the ring was full
+	sem_t sem;
+	pthread_t tid;
+	pthread_t producer;								// The only thread allowed to queue messages
+	char logbuf[LOGBUF_SZ];							// Writer thread message space
+} w;
+
+/**
+ * Returns the next free slot in the ring. The slot is
+ * not passed to the writer thread until commitSlot() is
+ * called.
+ *
+ * A full ring means that the writer thread is stalled on
+ * the file system, so the message is dropped and counted
+ * rather than written by the controller thread.
+ *
+ * @param[out] rv Set to -1 if the writer thread is not
+ * running or the caller is not the producer thread, so
+ * that the caller must do the write itself, or to 1 if
+ * the ring is full and the message is dropped.
+ *
+ * @returns The slot or NULL with rv set.
+ */
+static struct writerMsg *getFreeSlot(int *rv){
+
+	if (! w.isRunning.load(std::memory_order_acquire)
+			|| ! pthread_equal(pthread_self(), w.producer)){
+		*rv = -1;
+		return NULL;
+	}
+
+	unsigned int head = w.head.load(std::memory_order_relaxed);
+	unsigned int tail = w.tail.load(std::memory_order_acquire);
+
+	if (head - tail >= WRITER_RING_LEN){
+		w.dropped.fetch_add(1, std::memory_order_relaxed);
+		*rv = 1;
+		return NULL;
+	}
+	return &w.ring[head & (WRITER_RING_LEN - 1)];
+}
+
+/**
+ * Publishes the slot returned by getFreeSlot() to
+ * the writer thread and wakes the thread.
+ */
+static void commitSlot(void){
+	w.head.store(w.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	sem_post(&w.sem);
+}
+
+/**
+ * Queues a log message for the writer thread.
+ *
+ * @param[in] msg The message.
+ * @param[in] addTimestamp If "true" the message is
+ * prefixed with the time it was queued.
+ *
+ * @returns 0 if queued, 1 if dropped because the ring
+ * is full, else -1 if the caller must write the message
+ * itself.
+ */
+int queueLogMsg(const char *msg, bool addTimestamp){
+	int rv;
+	struct writerMsg *m = getFreeSlot(&rv);
+	if (m == NULL){
+		return rv;
+	}
+
+	m->type = addTimestamp ? WRITE_LOG : WRITE_LOG_NO_TIMESTAMP;
+	m->t = time(NULL);
+	strncpy(m->buf, msg, WRITER_BUF_SZ - 1);
+	m->buf[WRITER_BUF_SZ - 1] = '\0';
+	m->len = strlen(m->buf);
+
+	commitSlot();
+	return 0;
+}
+
+/**
+ * Queues a copy of a distribution for the writer thread.
+ *
+ * @param[in] distrib The distribution array.
+ * @param[in] len The length of the array.
+ * @param[in] scaleZero The array index of distribution zero.
+ * @param[in] rollover If "true" the forming file is moved
+ * to the completed file after it is written.
+ * @param[in] distrib_file The forming distribution file.
+ * @param[in] last_distrib_file The completed distribution file.
+ *
+ * @returns 0 if queued, 1 if dropped because the ring
+ * is full, else -1 if the caller must write the file
+ * itself.
+ */
+int queueDistrib(const int *distrib, int len, int scaleZero, bool rollover,
+		const char *distrib_file, const char *last_distrib_file){
+
+	if (len * (int)sizeof(int) > WRITER_BUF_SZ){
+		return -1;
+	}
+
+	int rv;
+	struct writerMsg *m = getFreeSlot(&rv);
+	if (m == NULL){
+		return rv;
+	}
+
+	m->type = WRITE_DISTRIB;
+	memcpy(m->buf, distrib, len * sizeof(int));
+	m->len = len;
+	m->scaleZero = scaleZero;
+	m->rollover = rollover;
+	m->filename = distrib_file;
+	m->last_filename = last_distrib_file;
+
+	commitSlot();
+	return 0;
+}
+
+/**
+ * Queues a checkpoint of the controller state for
+ * writeStateFile(). Called only by the controller thread.
+ *
+ * @param[in] s The checkpoint.
+ *
+ * @returns 0 if queued, 1 if dropped because the ring
+ * is full, else -1 if the writer thread is not running.
+ */
+int queueState(const struct savedState *s){
+
+	if (sizeof(struct savedState) > WRITER_BUF_SZ){
+		return -1;
+	}
+
+	int rv;
+	struct writerMsg *m = getFreeSlot(&rv);
+	if (m == NULL){
+		return rv;
+	}
+
+	m->type = WRITE_STATE;
+	memcpy(m->buf, s, sizeof(struct savedState));
+	m->len = sizeof(struct savedState);
+
+	commitSlot();
+	return 0;
+}
+
+/**
+ * Queues a sample of the clock frequency offset for
+ * addDriftSample(). Called only by the controller thread.
+ *
+ * @param[in] t The PPS second of the sample.
+ * @param[in] freqOffset The frequency offset in ppm.
+ *
+ * @returns 0 if queued, 1 if dropped because the ring
+ * is full, else -1 if the writer thread is not running.
+ */
+int queueDrift(int64_t t, double freqOffset){
+	int rv;
+	struct writerMsg *m = getFreeSlot(&rv);
+	if (m == NULL){
+		return rv;
+	}
+
+	m->type = WRITE_DRIFT;
+	m->t = (time_t)t;
+	memcpy(m->buf, &freqOffset, sizeof(double));
+	m->len = sizeof(double);
+
+	commitSlot();
+	return 0;
+}
+
+/**
+ * Queues the time correction and frequency offset of
+ * one second for addHistorySample(). Called only by the
+ * controller thread.
+ *
+ * @param[in] t The second of the PPS.
+ * @param[in] timeCorrection The time correction in microseconds.
+ * @param[in] freqOffset The frequency offset in ppm.
+ *
+ * @returns 0 if queued, 1 if dropped because the ring
+ * is full, else -1 if the writer thread is not running.
+ */
+int queueHistory(int64_t t, double timeCorrection, double freqOffset){
+	int rv;
+	struct writerMsg *m = getFreeSlot(&rv);
+	if (m == NULL){
+		return rv;
+	}
+
+	m->type = WRITE_HISTORY;
+	m->t = (time_t)t;
+	memcpy(m->buf, &timeCorrection, sizeof(double));
+	memcpy(m->buf + sizeof(double), &freqOffset, sizeof(double));
+	m->len = 2 * sizeof(double);
+
+	commitSlot();
+	return 0;
+}
+
+/**
+ * Queues an event record for appendJournalRecord().
+ * Called only by the controller thread.
+ *
+ * @param[in] r The record.
+ *
+ * @returns 0 if queued, 1 if dropped because the ring
+ * is full, else -1 if the writer thread is not running.
+ */
+int queueJournal(const struct ppsJournalRecord *r){
+	int rv;
+	struct writerMsg *m = getFreeSlot(&rv);
+	if (m == NULL){
+		return rv;
+	}
+
+	m->type = WRITE_JOURNAL;
+	memcpy(m->buf, r, sizeof(struct ppsJournalRecord));
+	m->len = sizeof(struct ppsJournalRecord);
+
+	commitSlot();
+	return 0;
+}
+
+/**
+ * Performs the file writes requested by the messages in
+ * the ring from tail up to head. Consecutive log messages
+ * are appended to the log file together by writeLogLines().
+ *
+ * @param[in] tail The ring index of the first message.
+ * @param[in] head The ring index after the last message.
+ *
+ * @returns The number of messages processed.
+ */
+static unsigned int processMsgs(unsigned int tail, unsigned int head){
+	struct logLine lines[LOG_BATCH_LEN];
+	int n = 0;
+
+	for (unsigned int i = tail; i != head && n < LOG_BATCH_LEN; i++){
+		struct writerMsg *m = &w.ring[i & (WRITER_RING_LEN - 1)];
+		if (m->type != WRITE_LOG && m->type != WRITE_LOG_NO_TIMESTAMP){
+			break;
+		}
+		lines[n].msg = m->buf;
+		lines[n].len = m->len;
+		lines[n].t = m->t;
+		lines[n].addTimestamp = (m->type == WRITE_LOG);
+		n += 1;
+	}
+	if (n > 0){
+		writeLogLines(lines, n);
+		return n;
+	}
+
+	struct writerMsg *m = &w.ring[tail & (WRITER_RING_LEN - 1)];
+	switch (m->type){
+	case WRITE_DISTRIB:
+		writeDistributionFile((int *)m->buf, m->len, m->scaleZero, m->rollover,
+				m->filename, m->last_filename, w.logbuf);
+		break;
+	case WRITE_STATE:
+		writeStateFile((const struct savedState *)m->buf, w.logbuf);
+		break;
+	case WRITE_DRIFT: {
+		double freqOffset;
+		memcpy(&freqOffset, m->buf, sizeof(double));
+		addDriftSample(m->t, freqOffset, w.logbuf);
+		break;
+	}
+	case WRITE_HISTORY: {
+		double timeCorrection, freqOffset;
+		memcpy(&timeCorrection, m->buf, sizeof(double));
+		memcpy(&freqOffset, m->buf + sizeof(double), sizeof(double));
+		addHistorySample(m->t, timeCorrection, freqOffset);
+		break;
+	}
+	case WRITE_JOURNAL: {
+		struct ppsJournalRecord r;
+		memcpy(&r, m->buf, sizeof(struct ppsJournalRecord));
+		appendJournalRecord(&r);
+		break;
+	}
+	}
+	return 1;
+}
+
+/**
+ * Drains the message ring each time the controller
+ * posts to the semaphore and exits, after the ring
+ * is empty, when stopWriterThread() is called. Also
+ * wakes at least once a second to sample the CPU
+ * temperature for the controller.
+ */
+static void *writerThread(void *arg){
+	sigset_t set;
+	struct timespec deadline, t_mono;
+	time_t lastSample = 0;
+
+	sigfillset(&set);									// Leave signals to the controller thread.
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	for (;;){
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += 1;
+		sem_timedwait(&w.sem, &deadline);
+
+		clock_gettime(CLOCK_MONOTONIC, &t_mono);
+		if (t_mono.tv_sec != lastSample){
+			lastSample = t_mono.tv_sec;
+			sampleTemperature();
+		}
+
+		unsigned int tail = w.tail.load(std::memory_order_relaxed);
+		unsigned int head;
+		while (tail != (head = w.head.load(std::memory_order_acquire))){
+			tail += processMsgs(tail, head);				// Slots are reused only after they are written.
+			w.tail.store(tail, std::memory_order_release);
+		}
+
+		unsigned int dropped = w.dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped > 0){
+			sprintf(w.logbuf, "writerThread(): Writer queue full. Dropped %u messages\n", dropped);
+			writeLogToFile(w.logbuf, time(NULL), true);
+		}
+
+		if (w.exitRequested.load(std::memory_order_acquire)
+				&& tail == w.head.load(std::memory_order_acquire)){
+			break;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Starts the writer thread at normal (SCHED_OTHER)
+ * priority. After this call, file writes requested
+ * from the calling thread are queued to the writer
+ * thread. Writes requested from other threads are
+ * made directly by those threads.
+ *
+ * @returns 0 on success or -1 on error.
+ */
+int startWriterThread(void){
+	pthread_attr_t attr;
+	struct sched_param param;
+
+	w.head.store(0);
+	w.tail.store(0);
+	w.dropped.store(0);
+	w.exitRequested.store(false);
+
+	if (sem_init(&w.sem, 0, 0) == -1){
+		sprintf(g.logbuf, "Can't init semaphore: %s\n", strerror(errno));
+		writeToLog(g.logbuf, "startWriterThread()");
+		return -1;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, WRITER_STACK_SZ);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);	// Don't inherit SCHED_FIFO
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	param.sched_priority = 0;
+	pthread_attr_setschedparam(&attr, &param);
+
+	w.producer = pthread_self();
+
+	int rv = pthread_create(&w.tid, &attr, &writerThread, NULL);
+	pthread_attr_destroy(&attr);
+	if (rv != 0){
+		sem_destroy(&w.sem);
+		sprintf(g.logbuf, "Can't create writer thread : %s\n", strerror(rv));
+		writeToLog(g.logbuf, "startWriterThread()");
+		return -1;
+	}
+
+	w.isRunning.store(true, std::memory_order_release);
+	return 0;
+}
+
+/**
+ * Writes any queued messages and stops the writer thread.
+ * Subsequent file writes are made directly by the caller.
+ */
+void stopWriterThread(void){
+	if (! w.isRunning.load()){
+		return;
+	}
+	w.isRunning.store(false, std::memory_order_release);
+	w.exitRequested.store(true, std::memory_order_release);
+	sem_post(&w.sem);
+
+	pthread_join(w.tid, NULL);
+	sem_destroy(&w.sem);
+}
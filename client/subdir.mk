@@ -4,13 +4,33 @@ OBJS += \
 ./pps-client.o \
 ./pps-files.o \
 ./pps-sntp.o \
-./pps-serial.o
+./pps-serial.o \
+./pps-writer.o \
+./pps-shm.o \
+./pps-control.o \
+./pps-clock.o \
+./pps-stats.o \
+./pps-history.o \
+./pps-stability.o \
+./pps-journal.o \
+./pps-drift.o \
+./pps-thermal.o
 
 CPP_DEPS += \
 ./pps-client.d \
 ./pps-files.d \
 ./pps-sntp.d \
-./pps-serial.d
+./pps-serial.d \
+./pps-writer.d \
+./pps-shm.d \
+./pps-control.d \
+./pps-clock.d \
+./pps-stats.d \
+./pps-history.d \
+./pps-stability.d \
+./pps-journal.d \
+./pps-drift.d \
+./pps-thermal.d
 
 # Each subdirectory must supply rules for building sources it contributes
 %.o: ./%.cpp
@@ -0,0 +1,286 @@
+/*
+ * pps-journal.cpp
+ *
+ * Created on: Oct 16, 2026
+ * Copyright (C) 2026 Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Decodes the event journal of the PPS-Client daemon.
+ *
+ * The journal is read through a read-only mapping, so it can be
+ * read while the daemon is writing it or copied from another
+ * machine and read here. The records are printed oldest first as
+ * text or as CSV, optionally only those of some event types, in a
+ * range of times or the last few that match.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../client/pps-journal.h"
+
+const char *journal_version = "pps-journal v1.0.0";
+
+/**
+ * The names of the event types indexed by PPS_EVENT_.
+ */
+static const char *eventName[PPS_NUM_EVENTS] = {
+	"unknown",
+	"start",
+	"exit",
+	"restart",
+	"clock-changed",
+	"fractional-error",
+	"fractional-correction",
+	"nist-correction",
+	"serial-correction",
+	"missed-pps",
+	"pps-lost",
+	"pps-resumed"
+};
+
+/**
+ * Selection and output options.
+ */
+static struct journalOptions {
+	bool select[PPS_NUM_EVENTS];				// Event types to print
+	int64_t since;								// Earliest realSec to print
+	int64_t until;								// Latest realSec to print
+	long last;									// Print only the last matching records if > 0
+	bool csv;
+} opt;
+
+/**
+ * Gets the event type named name.
+ *
+ * @returns The PPS_EVENT_ type or -1 if name is unknown.
+ */
+static int getEventType(const char *name, int len){
+	for (int i = 1; i < PPS_NUM_EVENTS; i++){
+		if ((int)strlen(eventName[i]) == len && strncmp(name, eventName[i], len) == 0){
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Selects the event types in a comma-separated list of names.
+ *
+ * @returns 0 on success or -1 if a name is unknown.
+ */
+static int selectEvents(const char *list){
+	memset(opt.select, 0, sizeof(opt.select));
+
+	const char *p = list;
+	while (*p != '\0'){
+		const char *end = strchr(p, ',');
+		int len = (end == NULL) ? strlen(p) : end - p;
+
+		int type = getEventType(p, len);
+		if (type == -1){
+			printf("Unknown event: %.*s\n", len, p);
+			return -1;
+		}
+		opt.select[type] = true;
+
+		p += len;
+		if (*p == ',') {
+			p += 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Parses a time given as seconds since the epoch or
+ * as a local "YYYY-MM-DD HH:MM:SS" or "YYYY-MM-DD".
+ *
+ * @returns 0 on success or -1 on error.
+ */
+static int parseTime(const char *str, int64_t *t){
+	struct tm tm;
+	char *end;
+
+	long long v = strtoll(str, &end, 10);
+	if (*end == '\0' && end != str){
+		*t = v;
+		return 0;
+	}
+
+	memset(&tm, 0, sizeof(tm));
+	end = strptime(str, "%Y-%m-%d %H:%M:%S", &tm);
+	if (end == NULL){
+		memset(&tm, 0, sizeof(tm));
+		end = strptime(str, "%Y-%m-%d", &tm);
+	}
+	if (end == NULL || *end != '\0'){
+		printf("Invalid time: %s\n", str);
+		return -1;
+	}
+	tm.tm_isdst = -1;
+	*t = mktime(&tm);
+	return 0;
+}
+
+/**
+ * Tests a record against the selection options.
+ */
+static bool isSelected(const struct ppsJournalRecord *r){
+	if (r->type >= PPS_NUM_EVENTS || ! opt.select[r->type]){
+		return false;
+	}
+	return r->realSec >= opt.since && r->realSec <= opt.until;
+}
+
+/**
+ * Prints a record as text or CSV.
+ */
+static void printRecord(const struct ppsJournalRecord *r){
+	struct tm tmp;
+	char timeStr[50];
+	time_t t = (time_t)r->realSec;
+
+	strftime(timeStr, sizeof(timeStr), "%F %H:%M:%S", localtime_r(&t, &tmp));
+	const char *name = (r->type < PPS_NUM_EVENTS) ? eventName[r->type] : eventName[0];
+
+	if (opt.csv){
+		printf("%llu,%lld,%s,%lld.%09lld,%u,%s,%.9g,%.9g\n", (unsigned long long)(r->index - 1),
+				(long long)r->realSec, timeStr, (long long)(r->monoNs / 1000000000),
+				(long long)(r->monoNs % 1000000000), r->seq_num, name, r->value[0], r->value[1]);
+	}
+	else {
+		printf("%8llu  %s  %10lld.%06lld  %8u  %-22s %.9g %.9g\n", (unsigned long long)(r->index - 1),
+				timeStr, (long long)(r->monoNs / 1000000000), (long long)(r->monoNs % 1000000000 / 1000),
+				r->seq_num, name, r->value[0], r->value[1]);
+	}
+}
+
+static void usage(void){
+	printf("Usage: pps-journal [options]\n"
+			"  -f file    The journal (default %s)\n"
+			"  -e events  Print only these comma-separated event types\n"
+			"  -s time    Print only events at or after this time\n"
+			"  -u time    Print only events at or before this time\n"
+			"  -n count   Print only the last count events that match\n"
+			"  -c         Print as CSV\n"
+			"  -l         List the event types\n"
+			"Times are seconds since the epoch or local \"YYYY-MM-DD HH:MM:SS\" or \"YYYY-MM-DD\".\n",
+			PPS_JOURNAL_FILE);
+}
+
+int main(int argc, char *argv[]){
+	const char *journalFile = PPS_JOURNAL_FILE;
+	struct stat st;
+	int c;
+
+	for (int i = 1; i < PPS_NUM_EVENTS; i++){
+		opt.select[i] = true;
+	}
+	opt.since = INT64_MIN;
+	opt.until = INT64_MAX;
+
+	while ((c = getopt(argc, argv, "f:e:s:u:n:clh")) != -1){
+		switch (c){
+		case 'f': journalFile = optarg; break;
+		case 'e':
+			if (selectEvents(optarg) == -1){
+				return 1;
+			}
+			break;
+		case 's':
+			if (parseTime(optarg, &opt.since) == -1){
+				return 1;
+			}
+			break;
+		case 'u':
+			if (parseTime(optarg, &opt.until) == -1){
+				return 1;
+			}
+			break;
+		case 'n': opt.last = atol(optarg); break;
+		case 'c': opt.csv = true; break;
+		case 'l':
+			for (int i = 1; i < PPS_NUM_EVENTS; i++){
+				printf("%s\n", eventName[i]);
+			}
+			return 0;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	int fd = open(journalFile, O_RDONLY);
+	if (fd == -1){
+		printf("Could not open %s: %s\n", journalFile, strerror(errno));
+		return 1;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size != sizeof(struct ppsJournal)){
+		printf("%s is not a %s journal\n", journalFile, journal_version);
+		close(fd);
+		return 1;
+	}
+	const struct ppsJournal *j = (const struct ppsJournal *)mmap(NULL, sizeof(struct ppsJournal),
+			PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (j == MAP_FAILED){
+		printf("Could not map %s: %s\n", journalFile, strerror(errno));
+		return 1;
+	}
+	if (j->magic != PPS_JOURNAL_MAGIC || j->version != PPS_JOURNAL_VERSION
+			|| j->recordSize != sizeof(struct ppsJournalRecord) || j->len != PPS_JOURNAL_LEN){
+		printf("%s is not a %s journal\n", journalFile, journal_version);
+		return 1;
+	}
+
+	uint64_t next = __atomic_load_n(&j->next, __ATOMIC_ACQUIRE);
+	uint64_t first = (next > PPS_JOURNAL_LEN) ? next - PPS_JOURNAL_LEN : 0;
+	struct ppsJournalRecord r;
+
+	if (opt.last > 0){										// Find the first of the last matching records
+		long count = 0;
+		uint64_t n = next;
+		while (n > first && count < opt.last){
+			n -= 1;
+			if (ppsReadJournalRecord(j, n, &r) == 0 && isSelected(&r)){
+				count += 1;
+			}
+		}
+		first = n;
+	}
+
+	if (opt.csv){
+		printf("index,real_sec,time,monotonic_sec,seq_num,event,value0,value1\n");
+	}
+	for (uint64_t n = first; n < next; n++){
+		if (ppsReadJournalRecord(j, n, &r) == 0 && isSelected(&r)){	// Records overwritten while
+			printRecord(&r);										// reading are skipped.
+		}
+	}
+
+	munmap((void *)j, sizeof(struct ppsJournal));
+	return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * pps-bench.cpp
+ *
+ * Created on: Oct 16, 2026
+ * Copyright (C) 2026 Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Measures the time spent in each stage of the per-second
+ * noise removal pipeline of the PPS-Client controller and in
+ * the whole makeTimeCorrection() path.
+ *
+ * Each stage of removeNoise() is called on its own with raw
+ * errors from a fixed-seed jitter and delay spike workload
+ * after the controller state has been set to that of a locked
+ * controller. makeTimeCorrection() is then timed second by
+ * second in a closed loop on the simulated clock of sim-clock.cpp,
+ * which stands in for adjtimex().
+ *
+ * The latency of each call is reported as percentiles so that
+ * the worst-case time spent in the real-time window can be
+ * tracked from release to release.
+ */
+
+#include "sim-clock.h"
+#include <getopt.h>
+#include <sys/mman.h>
+
+extern struct G g;
+extern struct clockBackend *clk;
+
+const char *sim_version = "pps-bench v1.0.0";
+
+/**
+ * Benchmark state.
+ */
+static struct benchLocalVars {
+	int nCalls;									// Timed calls of each stage
+	int nWarmup;								// Untimed calls before each stage
+	int settleSecs;								// Seconds of closed-loop operation before makeTimeCorrection() is timed
+	int64_t *ns;								// Latency of each timed call
+	double avgCorrection;						// Workload for setHardLimit()
+} b;
+
+static inline int64_t nowNs(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+}
+
+static int compareInt64(const void *a, const void *b){
+	int64_t d = *(const int64_t *)a - *(const int64_t *)b;
+	return (d > 0) - (d < 0);
+}
+
+/**
+ * Returns the next raw error in microseconds from
+ * the jitter and delay spike workload.
+ */
+static int nextRawError(void){
+	simModelLatency();
+	return (int)lround((sc.latency - sc.latencyMean) * 1e-3);
+}
+
+/**
+ * Puts the controller into the state of a controller
+ * that has locked to the PPS.
+ */
+static void setLockedState(void){
+	initialize(false);
+
+	g.seq_num = SECS_PER_HOUR;
+	g.activeCount = SECS_PER_HOUR;
+	g.isControlling = true;
+	g.slewIsLow = true;
+	g.hardLimit = HARD_LIMIT_1;
+	g.clampAbsolute = true;
+	g.invProportionalGain = INV_GAIN_1;
+	g.ppsCount = SECS_PER_HOUR;
+}
+
+/**
+ * Prints the latency percentiles of the timed calls.
+ */
+static void report(const char *name, int n){
+	int64_t sum = 0;
+
+	for (int i = 0; i < n; i++){
+		sum += b.ns[i];
+	}
+	qsort(b.ns, n, sizeof(int64_t), compareInt64);
+
+	printf("%-22s %8d %8.1lf %8lld %8lld %8lld %8lld\n", name, n, (double)sum / n,
+			(long long)b.ns[n / 2], (long long)b.ns[n - 1 - n / 100],
+			(long long)b.ns[n - 1 - n / 1000], (long long)b.ns[n - 1]);
+}
+
+#define TIME_STAGE(name, setup, call)						\
+	do {													\
+		setLockedState();									\
+		for (int i = 0; i < b.nWarmup + b.nCalls; i++){		\
+			int rawError = nextRawError();					\
+			(void)rawError;									\
+			setup;											\
+			int64_t t0 = nowNs();							\
+			call;											\
+			int64_t t1 = nowNs();							\
+			if (i >= b.nWarmup){							\
+				b.ns[i - b.nWarmup] = t1 - t0;				\
+			}												\
+		}													\
+		report(name, b.nCalls);								\
+	} while (0)
+
+/**
+ * Times makeTimeCorrection() second by second on the
+ * simulated clock after the controller has settled.
+ */
+static void timeMakeTimeCorrection(void){
+
+	initialize(false);
+
+	for (int k = 0; k < b.settleSecs + b.nCalls; k++){
+		simModelLatency();
+		simAdvanceTo(simPPSEdge(k));
+
+		clk->fetchPPS(NULL, NULL, &g.t);
+		detectMissedPPS();
+
+		int64_t t0 = nowNs();
+		makeTimeCorrection(g.t);
+		int64_t t1 = nowNs();
+
+		if (k >= b.settleSecs){
+			b.ns[k - b.settleSecs] = t1 - t0;
+		}
+		writeStatusStrings();
+
+		simAdvanceTo(simPPSEdge(k) + NSECS_PER_SEC / 2);
+	}
+	report("makeTimeCorrection", b.nCalls);
+}
+
+static void usage(void){
+	printf("Usage: pps-bench [options]\n"
+			"  -n calls  Timed calls of each stage (default 100000)\n"
+			"  -S secs   Closed-loop seconds before makeTimeCorrection() is timed (default 1200)\n"
+			"  -j nsec   Standard deviation of the latency jitter (default 800)\n"
+			"  -p prob   Probability of a delay spike each call (default 0.002)\n"
+			"  -a usec   Mean delay spike amplitude (default 50)\n"
+			"  -s seed   Random seed (default 1)\n"
+			"  -r        Run at SCHED_FIFO priority 99 with memory locked as the daemon does\n");
+}
+
+int main(int argc, char *argv[]){
+	int opt;
+	bool realtime = false;
+
+	simDefaults();
+	sc.jitter = 800.0;
+
+	b.nCalls = 100000;
+	b.nWarmup = 1000;
+	b.settleSecs = 1200;
+
+	while ((opt = getopt(argc, argv, "n:S:j:p:a:s:rh")) != -1){
+		switch (opt){
+		case 'n': b.nCalls = atoi(optarg); break;
+		case 'S': b.settleSecs = atoi(optarg); break;
+		case 'j': sc.jitter = atof(optarg); break;
+		case 'p': sc.spikeProb = atof(optarg); break;
+		case 'a': sc.spikeMean = atof(optarg) * 1e3; break;
+		case 's': sc.seed = (unsigned int)atoi(optarg); break;
+		case 'r': realtime = true; break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (b.nCalls < 1 || b.settleSecs < 0){
+		usage();
+		return 1;
+	}
+
+	if (realtime){
+		struct sched_param param;
+		param.sched_priority = 99;
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1
+				|| sched_setscheduler(0, SCHED_FIFO, &param) == -1){
+			printf("Could not run at real-time priority: %s\n", strerror(errno));
+			return 1;
+		}
+	}
+
+	b.ns = new int64_t[b.nCalls];
+
+	simStart("/dev/null", 0.0);
+	unsigned int seed = sc.seed;
+
+	printf("%s\n", sim_version);
+	printf("%-22s %8s %8s %8s %8s %8s %8s\n", "stage (ns)", "calls", "mean", "p50", "p99", "p99.9", "max");
+
+	TIME_STAGE("timer overhead", , );
+	TIME_STAGE("buildRawErrorDistrib", ,
+			buildRawErrorDistrib(rawError, g.rawErrorDistrib, &(g.rawErrorWeight), &(g.ppsCount)));
+	TIME_STAGE("detectDelaySpike", , detectDelaySpike(rawError));
+	TIME_STAGE("getTimeSlew", , getTimeSlew(rawError));
+	TIME_STAGE("setHardLimit", b.avgCorrection = 0.5 * simGaussian(),
+			setHardLimit(b.avgCorrection));
+	TIME_STAGE("clampJitter", , clampJitter(rawError));
+	TIME_STAGE("buildErrorDistrib", , buildErrorDistrib(rawError));
+	TIME_STAGE("buildJitterDistrib", , buildJitterDistrib(rawError));
+	TIME_STAGE("removeNoise", , removeNoise(rawError));
+
+	sc.seed = seed;
+	timeMakeTimeCorrection();
+
+	delete[] b.ns;
+	return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * pps-clock-sim.cpp
+ *
+ * Created on: Oct 16, 2026
+ * Copyright (C) 2026 Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Benchmarks the convergence and steady-state performance of
+ * the PPS-Client controller on a simulated system clock driven
+ * by an oscillator with a constant frequency offset, a random
+ * walk frequency wander and a temperature-driven frequency
+ * change.
+ *
+ * The controller can be restarted part way through the run to
+ * measure the convergence from a restart. Lock times are measured
+ * from the last start. The steady-state time error is summarized
+ * by its distribution and by its Allan deviation at octave
+ * intervals.
+ */
+
+#include "sim-clock.h"
+#include <getopt.h>
+
+extern struct G g;
+extern struct ppsFiles f;
+extern const char *config_file;
+
+const char *sim_version = "pps-clock-sim v1.0.0";
+
+static int compareDoubles(const void *a, const void *b){
+	double d = *(const double *)a - *(const double *)b;
+	return (d > 0.0) - (d < 0.0);
+}
+
+/**
+ * Returns the Allan deviation at averaging time m seconds
+ * of the time error x[] sampled once per second.
+ *
+ * @param[in] x The time error in nanoseconds.
+ * @param[in] n The number of samples.
+ * @param[in] m The averaging time in seconds.
+ */
+static double allanDeviation(const double *x, int n, int m){
+	double sum = 0.0;
+	int terms = n - 2 * m;
+
+	if (terms < 1){
+		return 0.0;
+	}
+	for (int i = 0; i < terms; i++){
+		double d = x[i + 2 * m] - 2.0 * x[i + m] + x[i];
+		sum += d * d;
+	}
+	return sqrt(sum / (2.0 * (double)m * (double)m * (double)terms)) * 1e-9;
+}
+
+static void usage(void){
+	printf("Usage: pps-clock-sim [options]\n"
+			"  -n secs   Seconds to simulate (default 14400)\n"
+			"  -d ppm    Oscillator frequency offset (default 20)\n"
+			"  -W ppm    Frequency random walk per root second (default 0)\n"
+			"  -T degC   Amplitude of the temperature cycle (default 0)\n"
+			"  -P secs   Period of the temperature cycle (default 3600)\n"
+			"  -k ppm    Frequency change per degree C (default 0.1)\n"
+			"  -o usec   Initial clock offset (default 100)\n"
+			"  -l usec   Mean PPS latency (default the controller zeroOffset)\n"
+			"  -j nsec   Standard deviation of the latency jitter (default 500)\n"
+			"  -p prob   Probability of a delay spike each second (default 0.002)\n"
+			"  -a usec   Mean delay spike amplitude (default 50)\n"
+			"  -s seed   Random seed (default 1)\n"
+			"  -R secs   Restart the controller at this second\n"
+			"  -S secs   Start of the steady-state interval (default the second half)\n"
+			"  -c file   PPS-Client config file (default none)\n"
+			"  -w file   Write the time error each second to a CSV file\n"
+			"  -g file   Write the controller log to a file (default none)\n");
+}
+
+int main(int argc, char *argv[]){
+	int opt;
+	int nSecs = 14400;
+	int restartAt = -1;
+	int steadyStart = -1;
+	double initOffset = 100.0;
+	const char *csvFile = NULL;
+	const char *logFile = "/dev/null";
+	FILE *csv = NULL;
+
+	simDefaults();
+	sc.tempco = 0.1;
+
+	while ((opt = getopt(argc, argv, "n:d:W:T:P:k:o:l:j:p:a:s:R:S:c:w:g:m:h")) != -1){
+		switch (opt){
+		case 'n': nSecs = atoi(optarg); break;
+		case 'd': sc.drift = atof(optarg); break;
+		case 'W': sc.wanderRate = atof(optarg); break;
+		case 'T': sc.tempAmp = atof(optarg); break;
+		case 'P': sc.tempPeriod = atof(optarg); break;
+		case 'k': sc.tempco = atof(optarg); break;
+		case 'o': initOffset = atof(optarg); break;
+		case 'l': sc.latencyMean = atof(optarg) * 1e3; break;
+		case 'j': sc.jitter = atof(optarg); break;
+		case 'p': sc.spikeProb = atof(optarg); break;
+		case 'a': sc.spikeMean = atof(optarg) * 1e3; break;
+		case 's': sc.seed = (unsigned int)atoi(optarg); break;
+		case 'R': restartAt = atoi(optarg); break;
+		case 'S': steadyStart = atoi(optarg); break;
+		case 'c': config_file = optarg; break;
+		case 'w': csvFile = optarg; break;
+		case 'g': logFile = optarg; break;
+		case 'm': strncpy(f.drift_file, optarg, sizeof(f.drift_file) - 1); break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (nSecs < 2){
+		usage();
+		return 1;
+	}
+	if (steadyStart < 0 || steadyStart >= nSecs){
+		steadyStart = nSecs / 2;
+	}
+
+	if (csvFile != NULL){
+		csv = fopen(csvFile, "w");
+		if (csv == NULL){
+			printf("Could not open %s: %s\n", csvFile, strerror(errno));
+			return 1;
+		}
+		fprintf(csv, "second,true_error_ns,oscillator_ppm,freq_offset,hard_limit,is_controlling\n");
+	}
+
+	double *err = new double[nSecs];
+
+	simStart(logFile, initOffset * 1e3);
+
+	int startedAt = 0, acquiredAt = -1, limit1At = -1, restarts = 0;
+
+	for (int k = 0; k < nSecs; k++){
+		if (k == restartAt){
+			initialize(false);							// As readPPS_SetTime() does on a restart
+			startedAt = k;
+			acquiredAt = -1;
+			limit1At = -1;
+		}
+
+		simModelLatency();
+		simAdvanceTo(simPPSEdge(k));					// The true PPS edge
+		err[k] = sc.offset;
+
+		int rv = readPPS_SetTime(false, NULL, NULL, NULL);
+		if (rv == -1){
+			printf("readPPS_SetTime() failed at second %d\n", k);
+			nSecs = k;
+			break;
+		}
+		if (rv == 1){
+			restarts += 1;
+			startedAt = k;
+			acquiredAt = -1;
+			limit1At = -1;
+		}
+		writeStatusStrings();
+
+		if (acquiredAt == -1 && g.isControlling){
+			acquiredAt = k;
+		}
+		if (limit1At == -1 && g.isControlling && g.hardLimit == HARD_LIMIT_1){
+			limit1At = k;
+		}
+
+		if (csv != NULL){
+			fprintf(csv, "%d,%.1lf,%.4lf,%.4lf,%d,%d\n", k, err[k], simOscillatorPPM(),
+					g.freqOffset, g.hardLimit, (int)g.isControlling);
+		}
+
+		simAdvanceTo(simPPSEdge(k) + NSECS_PER_SEC / 2);
+		simNextSecond();
+	}
+
+	printf("%s\n", sim_version);
+	printf("Simulated seconds:       %d\n", nSecs);
+	printf("Controller restarts:     %d\n", restarts);
+	printf("Last start at:           %d s\n", startedAt);
+	printf("Frequency lock after:    %d s\n", acquiredAt == -1 ? -1 : acquiredAt - startedAt);
+	printf("Hard limit 1 after:      %d s\n", limit1At == -1 ? -1 : limit1At - startedAt);
+
+	int n = nSecs - steadyStart;
+	if (n > 2){
+		const double *x = err + steadyStart;
+		double sum = 0.0, sumSq = 0.0;
+		for (int i = 0; i < n; i++){
+			sum += x[i];
+			sumSq += x[i] * x[i];
+		}
+
+		double *sorted = new double[n];
+		memcpy(sorted, x, n * sizeof(double));
+		qsort(sorted, n, sizeof(double), compareDoubles);
+
+		printf("Steady-state error from %d s (us):\n", steadyStart);
+		printf("  mean %.3lf  rms %.3lf\n", sum / n * 1e-3, sqrt(sumSq / n) * 1e-3);
+		printf("  min %.3lf  p1 %.3lf  p50 %.3lf  p99 %.3lf  max %.3lf\n", sorted[0] * 1e-3,
+				sorted[n / 100] * 1e-3, sorted[n / 2] * 1e-3, sorted[n - 1 - n / 100] * 1e-3,
+				sorted[n - 1] * 1e-3);
+		delete[] sorted;
+
+		printf("Allan deviation:\n");
+		for (int m = 1; m <= n / 3 && m > 0; m <<= 1){
+			printf("  tau %6d s  %.3le\n", m, allanDeviation(x, n, m));
+		}
+	}
+	printf("Frequency offset:        %.4lf ppm (oscillator %.4lf ppm)\n", g.freqOffset, simOscillatorPPM());
+
+	saveDriftModel(g.logbuf);
+	delete[] err;
+	if (csv != NULL){
+		fclose(csv);
+	}
+	return 0;
+}
@@ -0,0 +1,336 @@
+/*
+ * pps-sim.cpp
+ *
+ * Created on: Oct 16, 2026
+ * Copyright (C) 2026 Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Runs the PPS-Client controller against a simulated system
+ * clock and PPS source, faster than real time.
+ *
+ * Each simulated second the PPS interrupt is delayed from the
+ * true PPS edge by a latency that is either read from a trace
+ * file or generated from a model of fixed delay, Gaussian jitter
+ * and occasional delay spikes. The latency is timestamped by a
+ * simulated system clock that drifts at a constant rate and is
+ * adjusted by the controller through adjtimex() requests. Each
+ * second the controller sleeps until the start of its adaptive PPS
+ * window, as waitForPPS() does, and the full controller pipeline in
+ * readPPS_SetTime() processes the PPS.
+ *
+ * A trace file has one PPS latency in nanoseconds per line. A
+ * line containing "lost" is a missed PPS interrupt. Lines starting
+ * with '#' are ignored.
+ *
+ * The true time error of the simulated clock is reported as a
+ * summary of convergence time and steady-state error and can be
+ * written second by second to a CSV file. Limits can be set on the
+ * time to reach hard limit 1, on the rms and 99th percentile of the
+ * steady-state error, on the largest PPS window in the steady
+ * state and on the count of missed wakeup deadlines, in which case the exit status is 2 if any
+ * limit is exceeded so that "make test" can run the simulator as a
+ * regression test.
+ */
+
+#include "sim-clock.h"
+#include <getopt.h>
+
+extern struct G g;
+extern const char *config_file;
+
+const char *sim_version = "pps-sim v1.0.0";
+
+/**
+ * Replay state.
+ */
+static struct simLocalVars {
+	FILE *trace;
+	FILE *csv;
+	int maxLimit1At;							// Limits checked at the end of the run, or -1
+	double maxRms;
+	double maxP99;
+	int maxWindow;
+	int maxMissed;
+} sim;
+
+static int compareDoubles(const void *a, const void *b){
+	double d = *(const double *)a - *(const double *)b;
+	return (d > 0.0) - (d < 0.0);
+}
+
+/**
+ * Gets the latency of the next PPS from the trace
+ * file or from the latency model.
+ *
+ * @returns 0 on success or -1 at the end of the trace.
+ */
+static int nextLatency(void){
+	char line[100];
+
+	if (sim.trace == NULL){
+		simModelLatency();
+		return 0;
+	}
+
+	sc.lost = false;
+	while (fgets(line, sizeof(line), sim.trace) != NULL){
+		if (line[0] == '#' || line[0] == '\n'){
+			continue;
+		}
+		if (strncmp(line, "lost", 4) == 0){
+			sc.lost = true;
+			return 0;
+		}
+		sc.latency = atof(line);
+		return 0;
+	}
+	return -1;
+}
+
+/**
+ * Counts the PPS entries in the trace file.
+ */
+static int countTraceLines(FILE *fp){
+	char line[100];
+	int n = 0;
+
+	while (fgets(line, sizeof(line), fp) != NULL){
+		if (line[0] != '#' && line[0] != '\n'){
+			n += 1;
+		}
+	}
+	rewind(fp);
+	return n;
+}
+
+static void usage(void){
+	printf("Usage: pps-sim [options]\n"
+			"  -n secs   Seconds to simulate (default 7200 or the length of the trace)\n"
+			"  -r file   Replay PPS latencies in nanoseconds from a trace file\n"
+			"  -d ppm    Oscillator frequency error (default 20)\n"
+			"  -o usec   Initial clock offset (default 100)\n"
+			"  -l usec   Mean PPS latency (default the controller zeroOffset)\n"
+			"  -j nsec   Standard deviation of the latency jitter (default 500)\n"
+			"  -p prob   Probability of a delay spike each second (default 0.002)\n"
+			"  -a usec   Mean delay spike amplitude (default 50)\n"
+			"  -s seed   Random seed (default 1)\n"
+			"  -t usec   Convergence tolerance (default 1)\n"
+			"  -c file   PPS-Client config file (default none)\n"
+			"  -w file   Write the time error each second to a CSV file\n"
+			"  -g file   Write the controller log to a file (default none)\n"
+			"  -L secs   Fail if hard limit 1 is not reached by this second\n"
+			"  -E usec   Fail if the rms steady-state error exceeds this\n"
+			"  -Q usec   Fail if the 99th percentile of the steady-state error magnitude exceeds this\n"
+			"  -W usec   Fail if the steady-state PPS window exceeds this\n"
+			"  -M count  Fail if more wakeup deadlines than this are missed\n"
+			"The exit status is 2 if a limit is exceeded.\n");
+}
+
+int main(int argc, char *argv[]){
+	int opt;
+	int nSecs = 7200;
+	bool nGiven = false;
+	double initOffset = 100.0;
+	double tolerance = 1.0;
+	const char *traceFile = NULL;
+	const char *csvFile = NULL;
+	const char *logFile = "/dev/null";
+
+	memset(&sim, 0, sizeof(sim));
+	sim.maxLimit1At = -1;
+	sim.maxRms = -1.0;
+	sim.maxP99 = -1.0;
+	sim.maxWindow = -1;
+	sim.maxMissed = -1;
+	simDefaults();
+
+	while ((opt = getopt(argc, argv, "n:r:d:o:l:j:p:a:s:t:c:w:g:L:E:Q:W:M:h")) != -1){
+		switch (opt){
+		case 'n': nSecs = atoi(optarg); nGiven = true; break;
+		case 'r': traceFile = optarg; break;
+		case 'd': sc.drift = atof(optarg); break;
+		case 'o': initOffset = atof(optarg); break;
+		case 'l': sc.latencyMean = atof(optarg) * 1e3; break;
+		case 'j': sc.jitter = atof(optarg); break;
+		case 'p': sc.spikeProb = atof(optarg); break;
+		case 'a': sc.spikeMean = atof(optarg) * 1e3; break;
+		case 's': sc.seed = (unsigned int)atoi(optarg); break;
+		case 't': tolerance = atof(optarg); break;
+		case 'c': config_file = optarg; break;
+		case 'w': csvFile = optarg; break;
+		case 'g': logFile = optarg; break;
+		case 'L': sim.maxLimit1At = atoi(optarg); break;
+		case 'E': sim.maxRms = atof(optarg); break;
+		case 'Q': sim.maxP99 = atof(optarg); break;
+		case 'W': sim.maxWindow = atoi(optarg); break;
+		case 'M': sim.maxMissed = atoi(optarg); break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (traceFile != NULL){
+		sim.trace = fopen(traceFile, "r");
+		if (sim.trace == NULL){
+			printf("Could not open %s: %s\n", traceFile, strerror(errno));
+			return 1;
+		}
+		int n = countTraceLines(sim.trace);
+		if (! nGiven || n < nSecs){
+			nSecs = n;
+		}
+	}
+
+	if (csvFile != NULL){
+		sim.csv = fopen(csvFile, "w");
+		if (sim.csv == NULL){
+			printf("Could not open %s: %s\n", csvFile, strerror(errno));
+			return 1;
+		}
+		fprintf(sim.csv, "second,true_error_ns,latency_ns,raw_error,time_correction,hard_limit,freq_offset\n");
+	}
+
+	simStart(logFile, initOffset * 1e3);
+
+	int lastOutside = -1, acquiredAt = -1, limit1At = -1, restarts = 0, lost = 0;
+	int steadyWindow = 0, lateWakeups = 0;
+	int steadyStart = nSecs / 2;
+	int steadyCount = 0;
+	double steadySum = 0.0, steadySumSq = 0.0, steadyMax = 0.0;
+	double *steadyMag = new double[nSecs - steadyStart + 1];
+
+	int k;
+	for (k = 0; k < nSecs; k++){
+		if (nextLatency() == -1){
+			break;
+		}
+
+		setNextWakeTime(-getPPSWindow());
+		sleepUntilWakeTime();
+		startPhaseTiming();
+
+		if (sc.now < simPPSEdge(k)){
+			simAdvanceTo(simPPSEdge(k));					// The true PPS edge
+		}
+		else {
+			lateWakeups += 1;
+		}
+		double err = sc.offset;
+
+		int rv = readPPS_SetTime(false, NULL, NULL, NULL);
+		if (rv == -1){
+			printf("readPPS_SetTime() failed at second %d\n", k);
+			break;
+		}
+		restarts += rv;
+		if (rv == 0){
+			recordPhaseLatencies();
+		}
+		if (sc.lost){
+			lost += 1;
+		}
+		writeStatusStrings();
+
+		if (fabs(err) > tolerance * 1e3){
+			lastOutside = k;
+		}
+		if (acquiredAt == -1 && g.isControlling){
+			acquiredAt = k;
+		}
+		if (limit1At == -1 && g.isControlling && g.hardLimit == HARD_LIMIT_1){
+			limit1At = k;
+		}
+		if (k >= steadyStart){
+			steadyCount += 1;
+			steadySum += err;
+			steadySumSq += err * err;
+			if (fabs(err) > steadyMax){
+				steadyMax = fabs(err);
+			}
+			steadyMag[steadyCount - 1] = fabs(err);
+			if (getPPSWindow() > steadyWindow){
+				steadyWindow = getPPSWindow();
+			}
+		}
+
+		if (sim.csv != NULL){
+			fprintf(sim.csv, "%d,%.1lf,%.1lf,%d,%d,%d,%.4lf\n", k, err, sc.lost ? -1.0 : sc.latency,
+					g.rawError, g.timeCorrection, g.hardLimit, g.freqOffset);
+		}
+
+		simAdvanceTo(simPPSEdge(k) + NSECS_PER_SEC / 2);
+		simNextSecond();
+	}
+
+	printf("%s\n", sim_version);
+	printf("Simulated seconds:       %d\n", k);
+	printf("Lost PPS:                %d\n", lost);
+	printf("Controller restarts:     %d\n", restarts);
+	printf("Frequency lock at:       %d s\n", acquiredAt);
+	printf("Hard limit 1 at:         %d s\n", limit1At);
+	if (lastOutside + 1 < k){
+		printf("Converged to %.3lf us at: %d s\n", tolerance, lastOutside + 1);
+	}
+	else {
+		printf("Did not converge to %.3lf us\n", tolerance);
+	}
+	double rms = 0.0, p99 = 0.0;
+	if (steadyCount > 0){
+		double mean = steadySum / steadyCount;
+		rms = sqrt(steadySumSq / steadyCount) * 1e-3;
+		qsort(steadyMag, steadyCount, sizeof(double), compareDoubles);
+		p99 = steadyMag[steadyCount - 1 - steadyCount / 100] * 1e-3;
+		printf("Steady-state error:      mean %.3lf us, rms %.3lf us, p99 %.3lf us, max %.3lf us (last %d s)\n",
+				mean * 1e-3, rms, p99, steadyMax * 1e-3, steadyCount);
+	}
+	printf("Frequency offset:        %.4lf ppm (oscillator %.4lf ppm)\n", g.freqOffset, sc.drift);
+	printf("PPS window:              %d us now, %d us steady-state max\n", getPPSWindow(), steadyWindow);
+	printf("Missed wakeup deadlines: %u (%d wakeups after the PPS)\n", g.phaseLatency.missed, lateWakeups);
+
+	int status = 0;
+	if (sim.maxLimit1At >= 0 && (limit1At == -1 || limit1At > sim.maxLimit1At)){
+		printf("FAIL: hard limit 1 at %d s, limit %d s\n", limit1At, sim.maxLimit1At);
+		status = 2;
+	}
+	if (sim.maxRms >= 0.0 && (steadyCount == 0 || rms > sim.maxRms)){
+		printf("FAIL: rms steady-state error %.3lf us, limit %.3lf us\n", rms, sim.maxRms);
+		status = 2;
+	}
+	if (sim.maxP99 >= 0.0 && (steadyCount == 0 || p99 > sim.maxP99)){
+		printf("FAIL: p99 steady-state error %.3lf us, limit %.3lf us\n", p99, sim.maxP99);
+		status = 2;
+	}
+	if (sim.maxWindow >= 0 && (steadyCount == 0 || steadyWindow > sim.maxWindow)){
+		printf("FAIL: steady-state PPS window %d us, limit %d us\n", steadyWindow, sim.maxWindow);
+		status = 2;
+	}
+	if (sim.maxMissed >= 0 && g.phaseLatency.missed > (unsigned int)sim.maxMissed){
+		printf("FAIL: %u missed wakeup deadlines, limit %d\n", g.phaseLatency.missed, sim.maxMissed);
+		status = 2;
+	}
+
+	if (sim.csv != NULL){
+		fclose(sim.csv);
+	}
+	if (sim.trace != NULL){
+		fclose(sim.trace);
+	}
+	delete[] steadyMag;
+	return status;
+}
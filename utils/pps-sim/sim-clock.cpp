@@ -0,0 +1,275 @@
+/*
+ * sim-clock.cpp
+ *
+ * Created on: Oct 16, 2026
+ * Copyright (C) 2026 Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * The simulated system clock and PPS source on which the
+ * PPS-Client controller is run by the simulators.
+ *
+ * The system clock is driven by an oscillator whose frequency
+ * error is the sum of a constant offset, a random walk and a
+ * temperature-driven term from a sinusoidal temperature cycle,
+ * which the backend also reports as the CPU temperature.
+ * The adjtimex() requests of the controller take effect as the
+ * kernel applies them: single-shot offsets are slewed at
+ * SIM_SLEW_PPM, frequency corrections add to the oscillator
+ * frequency and ADJ_SETOFFSET steps the clock.
+ *
+ * The PPS interrupt of each second is timestamped by the system
+ * clock sc.latency nanoseconds after the true PPS edge.
+ */
+
+#include "sim-clock.h"
+
+extern struct G g;
+extern struct ppsFiles f;
+extern struct clockBackend *clk;
+extern const char *config_file;
+
+struct simClockVars sc;
+
+/**
+ * Gets the current frequency error of the
+ * oscillator in ppm.
+ */
+double simOscillatorPPM(void){
+	return sc.drift + sc.wander + sc.tempco * (simTemperature() - SIM_BASE_TEMP);
+}
+
+/**
+ * Gets the current temperature of the
+ * oscillator in degrees C.
+ */
+double simTemperature(void){
+	double temp = SIM_BASE_TEMP;
+
+	if (sc.tempAmp != 0.0 && sc.tempPeriod > 0.0){
+		double t = (double)(sc.now / NSECS_PER_SEC - SIM_START_SEC);
+		temp += sc.tempAmp * sin(2.0 * M_PI * t / sc.tempPeriod);
+	}
+	return temp;
+}
+
+/**
+ * Advances the simulated clock to true time t.
+ */
+void simAdvanceTo(int64_t t){
+	double dt = (double)(t - sc.now) * 1e-9;
+
+	sc.offset += (simOscillatorPPM() + sc.freqAdj) * 1e3 * dt;
+
+	double maxSlew = SIM_SLEW_PPM * 1e3 * dt;
+	double slew = fabs(sc.pending) < maxSlew ? sc.pending : copysign(maxSlew, sc.pending);
+	sc.offset += slew;
+	sc.pending -= slew;
+
+	sc.now = t;
+}
+
+/**
+ * Returns the true time of PPS edge k.
+ */
+int64_t simPPSEdge(int k){
+	return (SIM_START_SEC + k) * NSECS_PER_SEC;
+}
+
+/**
+ * Advances the random walk of the oscillator
+ * frequency by one second.
+ */
+void simNextSecond(void){
+	if (sc.wanderRate != 0.0){
+		sc.wander += sc.wanderRate * simGaussian();
+	}
+}
+
+/**
+ * Handles the adjtimex() requests made by the controller.
+ */
+static int simAdjustClock(struct timex *t){
+
+	if ((t->modes & ADJ_OFFSET_SINGLESHOT) == ADJ_OFFSET_SINGLESHOT){
+		if (t->modes != ADJ_OFFSET_SS_READ){
+			sc.pending = (double)t->offset * 1e3;		// Replaces any slew in progress
+		}
+	}
+	if (t->modes & ADJ_FREQUENCY){
+		sc.freqAdj = (double)t->freq / ADJTIMEX_SCALE;
+	}
+	if (t->modes & ADJ_SETOFFSET){
+		sc.offset += (double)t->time.tv_sec * 1e9 + (double)t->time.tv_usec * 1e3;
+	}
+	return TIME_OK;
+}
+
+/**
+ * Reads the simulated system clock. CLOCK_MONOTONIC
+ * is taken to be the true time.
+ */
+static int simGetTime(clockid_t clockId, struct timespec *ts){
+
+	simAdvanceTo(sc.now + SIM_CALL_NSECS);
+
+	int64_t t = sc.now;
+	if (clockId == CLOCK_REALTIME){
+		t += (int64_t)llround(sc.offset);
+	}
+	ts->tv_sec = t / NSECS_PER_SEC;
+	ts->tv_nsec = t % NSECS_PER_SEC;
+	return 0;
+}
+
+/**
+ * Returns the simulated system time at the PPS
+ * interrupt of the current second.
+ */
+static int simFetchPPS(pps_handle_t *handle, int *avail_mode, struct timespec *ts){
+
+	if (sc.lost){
+		simAdvanceTo(sc.now + NSECS_PER_SEC / 2);
+		return -1;
+	}
+
+	simAdvanceTo(sc.now + (int64_t)llround(sc.latency));
+
+	int64_t t = sc.now + (int64_t)llround(sc.offset);
+	ts->tv_sec = t / NSECS_PER_SEC;
+	ts->tv_nsec = t % NSECS_PER_SEC;
+	return 0;
+}
+
+/**
+ * Advances true time to an absolute time of the simulated
+ * clock. Returns at once if that time has passed.
+ */
+static int simSleepUntil(clockid_t clockId, const struct timespec *ts){
+	int64_t t = (int64_t)ts->tv_sec * NSECS_PER_SEC + ts->tv_nsec;
+
+	if (clockId == CLOCK_REALTIME){
+		t -= (int64_t)llround(sc.offset);
+	}
+	if (t > sc.now){
+		simAdvanceTo(t);
+	}
+	return 0;
+}
+
+/**
+ * Reads the temperature of the simulated oscillator.
+ */
+static int simGetTemperature(double *degC){
+	*degC = simTemperature();
+	return 0;
+}
+
+/**
+ * The backend that runs the controller on the
+ * simulated clock.
+ */
+static struct clockBackend simClock = {
+	"sim",
+	&simAdjustClock,
+	&simGetTime,
+	&simSleepUntil,
+	&simFetchPPS,
+	&simGetTemperature,
+	false
+};
+
+/**
+ * Returns a uniform random value in [0,1).
+ */
+double simUniform(void){
+	return (double)rand_r(&sc.seed) / ((double)RAND_MAX + 1.0);
+}
+
+/**
+ * Returns a Gaussian random value with zero mean
+ * and unit variance.
+ */
+double simGaussian(void){
+	double u1 = ((double)rand_r(&sc.seed) + 1.0) / ((double)RAND_MAX + 2.0);
+	double u2 = simUniform();
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/**
+ * Generates the latency of the next PPS from the
+ * latency model.
+ */
+void simModelLatency(void){
+
+	sc.lost = false;
+	sc.latency = sc.latencyMean + sc.jitter * simGaussian();
+
+	if (simUniform() < sc.spikeProb){
+		double v = ((double)rand_r(&sc.seed) + 1.0) / ((double)RAND_MAX + 2.0);
+		sc.latency += -sc.spikeMean * log(v);			// Exponentially distributed spike
+	}
+	if (sc.latency < 0.0){
+		sc.latency = 0.0;
+	}
+}
+
+/**
+ * Sets the default oscillator and latency model
+ * and an empty controller config. The mean latency
+ * defaults to the controller zeroOffset when it is
+ * left negative.
+ */
+void simDefaults(void){
+	memset(&sc, 0, sizeof(sc));
+	sc.drift = 20.0;
+	sc.tempPeriod = 3600.0;
+	sc.latencyMean = -1.0;
+	sc.jitter = 500.0;
+	sc.spikeProb = 0.002;
+	sc.spikeMean = 50000.0;
+	sc.seed = 1;
+
+	config_file = "/dev/null";
+}
+
+/**
+ * Points the controller at the simulated clock and
+ * initializes the controller half a second before
+ * the first PPS edge.
+ *
+ * @param[in] logFile The controller log file.
+ * @param[in] initOffset The initial offset of the
+ * system clock in nanoseconds.
+ */
+void simStart(const char *logFile, double initOffset){
+
+	strcpy(f.log_file, logFile);
+	strcpy(f.cpuinfo_file, "/dev/null");
+	strcpy(f.integral_state_file, "/dev/null");
+
+	sc.now = simPPSEdge(0) - NSECS_PER_SEC / 2;
+	sc.offset = initOffset;
+
+	clk = &simClock;
+
+	initialize(false);
+
+	if (sc.latencyMean < 0.0){
+		sc.latencyMean = g.zeroOffset * 1e3;
+	}
+}
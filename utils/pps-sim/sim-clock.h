@@ -0,0 +1,72 @@
+/*
+ * sim-clock.h
+ *
+ * Created on: Oct 16, 2026
+ * Copyright (C) 2026 Raymond S. Connell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SIM_CLOCK_H_
+#define SIM_CLOCK_H_
+
+#include "../../client/pps-client.h"
+
+#define SIM_START_SEC 1600000000LL				// True time of the first simulated PPS
+#define SIM_CALL_NSECS 2000						// Simulated time consumed by each clock read
+#define SIM_SLEW_PPM 500.0						// Kernel slew rate of ADJ_OFFSET_SINGLESHOT
+#define SIM_BASE_TEMP 50.0						// Mean oscillator temperature in degrees C
+
+/**
+ * The simulated system clock, oscillator and
+ * PPS source. All times are in nanoseconds.
+ */
+struct simClockVars {
+	int64_t now;								// True time
+	double offset;								// System clock time minus true time
+	double freqAdj;								// Frequency correction from adjtimex() in ppm
+	double pending;								// Single-shot offset still to be slewed
+
+	double drift;								// Oscillator: constant frequency error in ppm
+	double wanderRate;							// Random walk of the frequency in ppm per root second
+	double wander;								// Current random walk frequency error in ppm
+	double tempAmp;								// Amplitude of the temperature cycle in degrees C
+	double tempPeriod;							// Period of the temperature cycle in seconds
+	double tempco;								// Frequency change with temperature in ppm per degree C
+
+	double latency;								// PPS latency for the current second
+	bool lost;									// "true" if the current PPS is lost
+	double latencyMean;							// Latency model
+	double jitter;								// Standard deviation of the latency
+	double spikeProb;							// Probability of a delay spike each second
+	double spikeMean;							// Mean of the exponentially distributed spikes
+
+	unsigned int seed;
+};
+
+extern struct simClockVars sc;
+
+void simDefaults(void);
+void simStart(const char *logFile, double initOffset);
+void simAdvanceTo(int64_t t);
+int64_t simPPSEdge(int k);
+void simNextSecond(void);
+void simModelLatency(void);
+double simOscillatorPPM(void);
+double simTemperature(void);
+double simGaussian(void);
+double simUniform(void);
+
+#endif /* SIM_CLOCK_H_ */
@@ -0,0 +1,65 @@
+
+# Add inputs and outputs from these tool invocations to the build variables 
+CPP_SRCS += \
+./pps-sim.cpp \
+./pps-clock-sim.cpp \
+./pps-bench.cpp \
+./sim-clock.cpp 
+
+MAIN_OBJS += \
+./pps-sim.o \
+./pps-clock-sim.o \
+./pps-bench.o
+
+OBJS += \
+./sim-clock.o \
+./pps-client.o \
+./pps-files.o \
+./pps-sntp.o \
+./pps-serial.o \
+./pps-writer.o \
+./pps-shm.o \
+./pps-control.o \
+./pps-clock.o \
+./pps-stats.o \
+./pps-history.o \
+./pps-stability.o \
+./pps-journal.o \
+./pps-drift.o \
+./pps-thermal.o
+
+CPP_DEPS += \
+./pps-sim.d \
+./pps-clock-sim.d \
+./pps-bench.d \
+./sim-clock.d \
+./pps-client.d \
+./pps-files.d \
+./pps-sntp.d \
+./pps-serial.d \
+./pps-writer.d \
+./pps-shm.d \
+./pps-control.d \
+./pps-clock.d \
+./pps-stats.d \
+./pps-history.d \
+./pps-stability.d \
+./pps-journal.d \
+./pps-drift.d \
+./pps-thermal.d
+
+# Each subdirectory must supply rules for building sources it contributes
+%.o: ./%.cpp
+	@echo 'Building file: $<'
+	@echo 'Invoking: G++ Compiler'
+	g++ -O3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@:%.o=%.d)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
+# The controller is built from the client sources without its main()
+%.o: ../../client/%.cpp
+	@echo 'Building file: $<'
+	@echo 'Invoking: G++ Compiler'
+	g++ -DPPS_SIM -Wno-restrict -O3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@:%.o=%.d)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
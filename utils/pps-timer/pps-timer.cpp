@@ -32,6 +32,8 @@
 #include <errno.h>
 #include <math.h>
 #include <signal.h>
+#include <sys/mman.h>
+#include "../../client/pps-shm.h"
 
 #define NSECS_PER_SEC 1000000000
 #define SECS_PER_MINUTE 60
@@ -39,7 +41,6 @@
 #define SAMPLES_PER_USEC 2
 #define SAMPLE_INTVL (1.0 / (double)SAMPLES_PER_USEC)
 #define PROBE_TIME -15.0
-#define MSGBUF_SZ 10000
 
 #define TIME_DISTRIB_LEN 51
 #define MAX_DISTRIB_LEN 251
@@ -48,9 +49,12 @@ const char *version = "pps-timer v1.0.1";
 
 const char *time_distrib_file = "/var/local/pps-time-distrib-forming";
 const char *last_time_distrib_file = "/var/local/pps-time-distrib";
-const char *displayParams_file = "/run/shm/pps-display-params";							//!< Temporary file storing params for the status display
+const char *status_file = PPS_STATUS_SHM;										//!< The PPS-Client shared memory status block
 
-char paramsBuf[MSGBUF_SZ];
+const struct ppsStatus *statusShm = NULL;
+uint32_t *statusWaiters = NULL;
+struct ppsStatus statusBuf;
+uint32_t lastGeneration = 0;
 
 int sysCommand(const char *cmd){
 	int rv = system(cmd);
@@ -476,50 +480,58 @@ int assignProcessorAffinity(void){
 }
 
 bool jitterIsAcceptable(){
-	struct stat stat_buf;
-	int jitter;
 
-	int fd = open(displayParams_file, O_RDONLY);
-	if (fd == -1){
-		printf("jitterIsAcceptable(): Could not open displayParams_file");
-		printf("%s", displayParams_file);
-		printf("\n");
-		return false;
-	}
+	if (statusShm == NULL){
+		struct stat stat_buf;
 
-	fstat(fd, &stat_buf);
-	int sz = stat_buf.st_size;
+		int prot = PROT_READ | PROT_WRITE;						// Writable if permitted so that
+		int fd = open(status_file, O_RDWR);						// ppsWaitForUpdate() can count
+		if (fd == -1){											// this reader as a waiter.
+			prot = PROT_READ;
+			fd = open(status_file, O_RDONLY);
+		}
+		if (fd == -1){
+			printf("jitterIsAcceptable(): Could not open status_file");
+			printf("%s", status_file);
+			printf("\n");
+			return false;
+		}
 
-	if (sz >= MSGBUF_SZ){
-		printf("jitterIsAcceptable(): Buffer is too small. Size is %d\n", sz);
-		close(fd);
-		return false;
-	}
-	if (sz == 0){
-		printf("jitterIsAcceptable(): Bad file read. Size is %d\n", sz);
+		if (fstat(fd, &stat_buf) == -1 || stat_buf.st_size < (off_t)sizeof(struct ppsStatus)){
+			printf("jitterIsAcceptable(): %s is not a PPS-Client status block\n", status_file);
+			close(fd);
+			return false;
+		}
+
+		void *p = mmap(NULL, sizeof(struct ppsStatus), prot, MAP_SHARED, fd, 0);
 		close(fd);
-		return false;
+		if (p == MAP_FAILED){
+			printf("jitterIsAcceptable(): Could not map status_file. Error: %s\n", strerror(errno));
+			return false;
+		}
+		statusShm = (const struct ppsStatus *)p;
+		if (prot & PROT_WRITE){
+			statusWaiters = &((struct ppsStatus *)p)->waiters;
+		}
 	}
 
-	int rv = read(fd, paramsBuf, sz);
-	close(fd);
-	if (rv == -1){
-		printf("jitterIsAcceptable(): Read paramsBuf failed with error: %s\n", strerror(errno));
+	struct timespec timeout = {0, 500000000};		// Wait up to a half second for PPS-Client
+	ppsWaitForUpdate(&statusShm->generation, statusWaiters, lastGeneration, &timeout);	// to publish this PPS.
+
+	if (ppsReadStatus(statusShm, &statusBuf) == -1){
+		printf("jitterIsAcceptable(): Could not read the PPS-Client status\n");
 		return false;
 	}
 
-	paramsBuf[sz] = '\0';
+	lastGeneration = statusBuf.generation;
 
-	char *sv = strstr(paramsBuf, "jitter");
-	if (sv != NULL){								// Is a standard status line containing "jitter".
-		sscanf(sv, "jitter: %d ", &jitter);
+	uint32_t status = statusBuf.params.status;
+	if ((status & PPS_STATUS_RUNNING) && (status & PPS_STATUS_PARAMS_VALID)){	// Is a standard status line
+		int jitter = statusBuf.params.jitter;
 		if (jitter < 3 && jitter > -3){
 			return true;
 		}
 	}
-	else {											// Is an informational or error message
-		return false;
-	}
 
 	return false;
 }